@@ -12,15 +12,20 @@
 
 #include "klee/Constraints.h"
 #include "klee/Expr.h"
+#include "klee/Internal/ADT/ImmutableMap.h"
 #include "klee/Internal/ADT/TreeStream.h"
 
 // FIXME: We do not want to be exposing these? :(
 #include "../../lib/Core/AddressSpace.h"
 #include "../../lib/Core/Thread.h"
 #include "../../lib/Core/MemoryAccessEntry.h"
+#include "../../lib/Core/MemoryAccessShadow.h"
+#include "../../lib/Core/SchedulePoint.h"
+#include "../../lib/Core/SchedulingHistory.h"
 #include "../../lib/Core/VectorClock.h"
 #include "klee/Internal/Module/KInstIterator.h"
 
+#include <deque>
 #include <map>
 #include <set>
 #include <vector>
@@ -40,7 +45,7 @@ llvm::raw_ostream &operator<<(llvm::raw_ostream &os, const MemoryMap &mm);
 /// @brief ExecutionState representing a path under exploration
 class ExecutionState {
 public:
-  typedef std::map<Thread::thread_id_t, Thread> threads_ty;
+  typedef ImmutableMap<Thread::thread_id_t, ref<Thread> > threads_ty;
   typedef std::map<Thread::wlist_id_t, std::set<Thread::thread_id_t> > wlists_ty;
 
 private:
@@ -130,13 +135,45 @@ public:
   // @brief Current time
   uint64_t stateTime;
 
-  // @brief Threads in current state
+  // @brief Threads in current state, shared with the states forked from it
+  // until they are modified
   threads_ty threads;
 
-  // @brief Pointer to current thread
-  threads_ty::iterator crtThreadIt;
-  Thread &crtThread() { return crtThreadIt->second; }
-  const Thread &crtThread() const { return crtThreadIt->second; }
+private:
+  /// The threads where t->copyOnWriteOwner == threadsCowKey are owned by
+  /// this state and can be modified in place.
+  ///
+  /// \invariant forall t in threads, t->copyOnWriteOwner <= threadsCowKey
+  mutable unsigned threadsCowKey;
+
+  /// The current thread, if it was looked up since it was scheduled. It is
+  /// only writeable while its copyOnWriteOwner matches threadsCowKey.
+  Thread *crtThreadCache;
+
+public:
+  // @brief Id of the current thread
+  Thread::thread_id_t crtThreadId;
+
+  // @brief Current thread, copied first if it is shared with other states
+  Thread &crtThread() {
+    if (!crtThreadCache || crtThreadCache->copyOnWriteOwner != threadsCowKey)
+      crtThreadCache = &getWriteableThread(crtThreadId);
+    return *crtThreadCache;
+  }
+  const Thread &crtThread() const {
+    return crtThreadCache ? *crtThreadCache : getThread(crtThreadId);
+  }
+
+  // @brief Get the specified thread for reading
+  const Thread &getThread(Thread::thread_id_t tid) const {
+    const threads_ty::value_type *res = threads.lookup(tid);
+    assert(res && "thread does not exist");
+    return *res->second;
+  }
+
+  // @brief Get the specified thread for writing, copying it first if it is
+  // shared with other states
+  Thread &getWriteableThread(Thread::thread_id_t tid);
 
   // @brief Waiting lists to block threads
   wlists_ty waitingLists;
@@ -145,54 +182,94 @@ public:
   // @brief Accumulated preemptions
   unsigned int preemptions;
 
-  // @brief List of context switches performed
-  std::vector<Thread::thread_id_t> schedulingHistory;
+  // @brief List of context switches performed, sharing its prefix with the
+  // states forked from this one
+  SchedulingHistory schedulingHistory;
 
-  std::vector<Thread::thread_id_t>::size_type getSchedulingIndex() {
+  SchedulingHistory::size_type getSchedulingIndex() const {
     return schedulingHistory.size();
   }
 
+  // @brief PCT: priority of each thread, higher runs first
+  std::map<Thread::thread_id_t, unsigned> pctPriorities;
+
+  // @brief PCT: scheduling indexes at which the priority of the running
+  // thread is lowered, the next one at the back
+  std::vector<SchedulingHistory::size_type> pctChangePoints;
+
+  // @brief Scheduling points of the path, only tracked with DPOR or sleep
+  // sets. The point for scheduling index i is at position i-1
+  std::vector<ref<SchedulePoint> > schedulePoints;
+
+  // @brief Threads whose next transition was already explored from an
+  // equivalent state, with the footprint of that transition
+  typedef std::map<Thread::thread_id_t, const TransitionFootprint*> sleep_set_t;
+  sleep_set_t sleepSet;
+
+  // @brief Threads explored before the current one at the last scheduling
+  // point, which join the sleep set once their footprint is known
+  std::set<Thread::thread_id_t> pendingSleep;
+
+  // @brief The current transition synchronized with other threads
+  bool transitionSynchronizes;
+
+  // @brief The state woke a thread other than the first one of a waiting
+  // list, which the replay of its schedule does not reproduce
+  bool notifiedOther;
+
+  // @brief Scheduling index of the last transition whose notify forked, plus
+  // one, or 0 if none did
+  SchedulingHistory::size_type lastNotifyFork;
+
   // @brief Create a new thread in the state
   Thread& createThread(Thread::thread_id_t tid, KFunction *kf);
 
   // @brief Terminate the specified thread
-  void terminateThread(threads_ty::iterator it);
+  void terminateThread(Thread::thread_id_t tid);
 
   // @brief Get next thread to be scheduled (round robin)
-  threads_ty::iterator nextThread(threads_ty::iterator it) {
+  Thread::thread_id_t nextThread(Thread::thread_id_t tid) const {
+    threads_ty::iterator it = threads.upper_bound(tid);
     if (it == threads.end())
       it = threads.begin();
-    else {
-      it++;
-      if (it == threads.end())
-        it = threads.begin();
-    }
-    return it;
+    return it->first;
   }
 
   // @brief Get enabled threads id
-  std::set<Thread::thread_id_t> enabledThreadIds() {
+  std::set<Thread::thread_id_t> enabledThreadIds() const {
     std::set<Thread::thread_id_t> enabled;
-    for (threads_ty::iterator it = threads.begin();
-         it != threads.end();  it++)
-      if (it->second.enabled)
-        enabled.insert(it->second.tid);
+    for (threads_ty::iterator it = threads.begin(), ite = threads.end();
+         it != ite; ++it)
+      if (it->second->enabled)
+        enabled.insert(it->first);
     return enabled;
   }
 
   // @brief Get all threads id
-  std::set<Thread::thread_id_t> threadIds() {
+  std::set<Thread::thread_id_t> threadIds() const {
     std::set<Thread::thread_id_t> ids;
     for (threads_ty::iterator it = threads.begin(), ite = threads.end();
          it != ite ; ++it)
-      ids.insert(it->second.tid);
+      ids.insert(it->first);
+    return ids;
+  }
+
+  // @brief Get sleeping threads id
+  std::set<Thread::thread_id_t> sleepingThreadIds() {
+    std::set<Thread::thread_id_t> ids;
+    for (sleep_set_t::iterator it = sleepSet.begin(), ite = sleepSet.end();
+         it != ite ; ++it)
+      ids.insert(it->first);
     return ids;
   }
 
   // @brief Set thread as active thread
-  void scheduleNext(threads_ty::iterator it) {
-    assert(it != threads.end());
-    crtThreadIt = it;
+  void scheduleNext(Thread::thread_id_t tid) {
+    assert(threads.count(tid));
+    if (tid != crtThreadId) {
+      crtThreadId = tid;
+      crtThreadCache = 0;
+    }
   }
 
   // @brief Generate a new waiting list
@@ -204,7 +281,7 @@ public:
   void notifyAll(Thread::wlist_id_t wlist);
 
 private:
-  ExecutionState() : ptreeNode(0) {}
+  ExecutionState() : ptreeNode(0), threadsCowKey(1), crtThreadCache(0) {}
 
   void setupMain(KFunction *kf);
 public:
@@ -230,16 +307,68 @@ public:
   bool merge(const ExecutionState &b);
   void dumpStack(llvm::raw_ostream &out) const;
 
-  /* Map of memory object ids and corresponding race candidates memory accesses*/
+  /* Map of memory object ids and corresponding race candidates memory accesses
+     to symbolic addresses */
   typedef std::map<MemoryObject::id_t, std::vector<ref<MemoryAccessEntry> > > memory_access_register_t;
   memory_access_register_t raceCandidates;
 
-  std::vector<ref<MemoryAccessEntry> > memoryAccesses;
+  /* Map of memory object ids and shadow of the race candidates memory accesses
+     to concrete addresses */
+  typedef std::map<MemoryObject::id_t, MemoryAccessShadow> memory_access_shadow_t;
+  memory_access_shadow_t accessShadows;
+
+  /// Memory accesses logged along the path, oldest first
+  std::deque<ref<MemoryAccessEntry> > memoryAccesses;
+
+  /// Size of memoryAccesses that triggers the next eviction of ordered accesses
+  size_t nextAccessEviction;
+
+  /* Map of lock and waiting list ids and the last thread and scheduling index
+     operating on them, used to find dependent synchronizations with DPOR */
+  typedef std::map<uint64_t, std::pair<Thread::thread_id_t,
+                                       std::vector<Thread::thread_id_t>::size_type> > sync_register_t;
+  sync_register_t lockOperations;
+  sync_register_t waitListOperations;
+
+  /// Vector clocks published by the synchronization objects, indexed by the
+  /// address identifying each object
+  typedef std::map<uint64_t, ref<VectorClock> > sync_clocks_t;
+  sync_clocks_t syncClocks;
 
   bool logMemAccesses;
 
+  /// Pairs of conflicting accesses not ordered by synchronization found on
+  /// the path, whether or not their race was reported before
+  unsigned unorderedConflicts;
+
+  /// Instructions executed since the state reported a race never reported
+  /// before, 0 if it did not report any
+  unsigned instsSinceNewRace;
+
+  /// Drop the accesses that happen before the clock of every thread, they
+  /// cannot race with any later access. The accesses of the current
+  /// transition are kept for the sleep sets.
+  void evictOrderedAccesses();
+
+  /// Drop the oldest accesses, keeping the last \a keep ones
+  void evictOldestAccesses(size_t keep);
+
   void updateVectorClock(Thread::thread_id_t tid, ref<VectorClock> vc);
+
+  /// The current thread synchronizes with the last release on \a sync
+  void acquireVectorClock(uint64_t sync);
+  /// Publish the clock of the current thread on \a sync, replacing or
+  /// joining the clock already published there
+  void releaseVectorClock(uint64_t sync, bool merge);
+  /// Start the clock of thread \a tid just created by the current thread
+  void forkVectorClock(Thread::thread_id_t tid);
+  /// Forget the clock published on \a sync
+  void clearVectorClock(uint64_t sync) { syncClocks.erase(sync); }
   void updateLockset(Thread::thread_id_t tid, uint64_t lock_id, bool isAcquire, bool isWriteMode);
+
+private:
+  void removeAccesses(const std::set<const MemoryAccessEntry*> &evicted,
+                      const std::set<MemoryObject::id_t> &objects);
 };
 }
 #endif
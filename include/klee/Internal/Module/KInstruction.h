@@ -53,6 +53,20 @@ namespace klee {
     /// instruction.
     uint64_t offset;
   };
+
+  /// KMemAccessInstruction - A direct call to klee_mem_access. The constant
+  /// arguments inserted by the instrumentation are decoded when the module is
+  /// prepared, so the executor does not need to go through the generic call
+  /// path.
+  struct KMemAccessInstruction : KInstruction {
+    /// decoded - Whether every argument but the address is a constant, so
+    /// the fields below are valid.
+    bool decoded;
+    unsigned bytes;
+    bool isWrite;
+    bool isAtomic;
+    bool isRaceCandidate;
+  };
 }
 
 #endif
@@ -93,6 +93,7 @@ namespace klee {
     
     // Some useful functions to know the address of
     llvm::Function *kleeMergeFn;
+    llvm::Function *kleeMemAccessFn;
 
     // Our shadow versions of LLVM structures.
     std::vector<KFunction*> functions;
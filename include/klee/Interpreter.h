@@ -43,6 +43,17 @@ public:
   virtual void processTestCase(const ExecutionState &state,
                                const char *err, 
                                const char *suffix) = 0;
+
+  /// Called in each worker process of a parallel exploration, test cases
+  /// must not collide with the ones of the other workers.
+  virtual void setWorker(unsigned index, unsigned count) {}
+
+  /// Hand the exploration below \a state over to another process, as a
+  /// schedule prefix to replay. Returns false if the state was not exported.
+  virtual bool exportSchedulePrefix(const ExecutionState &state) { return false; }
+
+  /// Whether other processes wait for schedule prefixes to explore.
+  virtual bool hasIdleWorkers() { return false; }
 };
 
 class Interpreter {
@@ -77,8 +88,13 @@ public:
     /// symbolic execution on concrete programs.
     unsigned MakeConcreteSymbolic;
 
+    /// Keep exploring interleavings once the scheduling steps of the
+    /// replayed test case have been consumed.
+    bool AllowPartialScheduling;
+
     InterpreterOptions()
-      : MakeConcreteSymbolic(false)
+      : MakeConcreteSymbolic(false),
+        AllowPartialScheduling(false)
     {}
   };
 
@@ -129,6 +145,10 @@ public:
                                  char **argv,
                                  char **envp) = 0;
 
+  // wait for the worker processes forked by runFunctionAsMain() to
+  // finish. see --parallel-workers.
+  virtual void waitWorkers() = 0;
+
   /*** Runtime options ***/
 
   virtual void setHaltExecution(bool value) = 0;
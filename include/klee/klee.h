@@ -179,9 +179,29 @@ extern "C" {
   /* Copies the vc into the tid thread */
   void klee_vclock_send(uint64_t tid, void *vc, size_t nelements);
 
+  /* Joins the vector clock published on the sync object into the clock of
+     the current thread, then ticks the current thread */
+  void klee_vclock_acquire(void *sync);
+
+  /* Publishes the vector clock of the current thread on the sync object,
+     joining it with the one already published if merge is set, then ticks
+     the current thread */
+  void klee_vclock_release(void *sync, char merge);
+
+  /* Starts the vector clock of the tid thread, created by the current one */
+  void klee_vclock_fork(uint64_t tid);
+
+  /* Forgets the vector clock published on the sync object */
+  void klee_vclock_clear(void *sync);
+
   /* Reports a memory operation */
   void klee_mem_access(void *addr, size_t bytes, char isWrite, char isAtomic);
 
+  /* Reports count memory operations of the given size, starting at base and
+     stride bytes apart */
+  void klee_mem_access_range(void *base, size_t bytes, size_t stride, size_t count,
+                             char isWrite, char isRaceCandidate);
+
   /* Adds the mutex to the specified thread lockset */
   void klee_lockset_update(uint64_t tid, void *mutex, char isAcquire, char isWriteMode);
   
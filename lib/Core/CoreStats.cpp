@@ -19,10 +19,23 @@ Statistic stats::forks("Forks", "Forks");
 Statistic stats::instructionRealTime("InstructionRealTimes", "Ireal");
 Statistic stats::instructionTime("InstructionTimes", "Itime");
 Statistic stats::instructions("Instructions", "I");
+Statistic stats::memoryAccesses("MemoryAccesses", "MAcc");
 Statistic stats::minDistToReturn("MinDistToReturn", "Rdist");
 Statistic stats::minDistToUncovered("MinDistToUncovered", "UCdist");
+Statistic stats::overlapQueries("OverlapQueries", "OQ");
+Statistic stats::overlapTime("OverlapTime", "OQtime");
+Statistic stats::preemptionStatesAccess("PreemptionStatesAccess", "PSAcc");
+Statistic stats::preemptionStatesAtomic("PreemptionStatesAtomic", "PSAtom");
+Statistic stats::preemptionStatesPthread("PreemptionStatesPthread", "PSPth");
+Statistic stats::prunedSchedules("PrunedSchedules", "PSched");
+Statistic stats::exportedSchedules("ExportedSchedules", "ESched");
+Statistic stats::raceCandidates("RaceCandidates", "RCand");
+Statistic stats::raceDetectionTime("RaceDetectionTime", "RDtime");
+Statistic stats::raceLockedCandidates("RaceLockedCandidates", "RCandLock");
+Statistic stats::raceOrderedCandidates("RaceOrderedCandidates", "RCandHB");
 Statistic stats::reachableUncovered("ReachableUncovered", "IuncovReach");
 Statistic stats::resolveTime("ResolveTime", "Rtime");
+Statistic stats::scheduleForks("ScheduleForks", "SForks");
 Statistic stats::solverTime("SolverTime", "Stime");
 Statistic stats::states("States", "States");
 Statistic stats::trueBranches("TrueBranches", "Bt");
@@ -30,6 +30,41 @@ namespace stats {
   /// The number of process forks.
   extern Statistic forks;
 
+  /// The number of forked schedules discarded without being explored.
+  extern Statistic prunedSchedules;
+
+  /// The number of states handed over to other processes as schedule prefixes.
+  extern Statistic exportedSchedules;
+
+  /// The number of states forked to explore alternative schedules.
+  extern Statistic scheduleForks;
+
+  /// The states forked at the preemption points added by the
+  /// ThreadPreemptionPass around pthread calls, before memory accesses and
+  /// before atomic accesses.
+  extern Statistic preemptionStatesPthread;
+  extern Statistic preemptionStatesAccess;
+  extern Statistic preemptionStatesAtomic;
+
+  /// The number of memory accesses logged for race detection.
+  extern Statistic memoryAccesses;
+
+  /// The number of earlier accesses checked for a race with a new one.
+  extern Statistic raceCandidates;
+
+  /// The candidates discarded because they are ordered by happens-before.
+  extern Statistic raceOrderedCandidates;
+
+  /// The candidates discarded because both accesses hold a common lock.
+  extern Statistic raceLockedCandidates;
+
+  /// The number of solver queries issued to check if accesses overlap.
+  extern Statistic overlapQueries;
+  extern Statistic overlapTime;
+
+  /// Time spent checking the candidates of new accesses for races.
+  extern Statistic raceDetectionTime;
+
   /// Number of states, this is a "fake" statistic used by istats, it
   /// isn't normally up-to-date.
   extern Statistic states;
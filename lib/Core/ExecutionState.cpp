@@ -26,6 +26,7 @@
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <algorithm>
 #include <iomanip>
 #include <sstream>
 #include <cassert>
@@ -60,24 +61,33 @@ ExecutionState::ExecutionState(KFunction *kf) :
     forkDisabled(false),
     ptreeNode(0),
 
+    threadsCowKey(1),
+    crtThreadCache(0),
     wlistCounter(1),
     preemptions(0),
-    logMemAccesses(false) {
+    transitionSynchronizes(false),
+    notifiedOther(false),
+    lastNotifyFork(0),
+    nextAccessEviction(0),
+    logMemAccesses(false),
+    unorderedConflicts(0),
+    instsSinceNewRace(0) {
   setupMain(kf);
   stateTime = TimeSeed;
 }
 
 ExecutionState::ExecutionState(const std::vector<ref<Expr> > &assumptions)
   : constraints(assumptions), queryCost(0.), ptreeNode(0),
-    wlistCounter(1), preemptions(0), logMemAccesses(false) {
+    threadsCowKey(1), crtThreadCache(0), wlistCounter(1), preemptions(0), transitionSynchronizes(false),
+    notifiedOther(false), lastNotifyFork(0), nextAccessEviction(0), logMemAccesses(false), unorderedConflicts(0),
+    instsSinceNewRace(0) {
   setupMain(NULL);
   stateTime = TimeSeed;
 }
 
 void ExecutionState::setupMain(KFunction *kf) {
-  Thread mainThread = Thread(0, kf);
-  threads.insert(std::make_pair(mainThread.tid, mainThread));
-  crtThreadIt = threads.begin();
+  createThread(0, kf);
+  crtThreadId = 0;
 }
 
 ExecutionState::~ExecutionState() {
@@ -89,10 +99,8 @@ ExecutionState::~ExecutionState() {
     if (mo->refCount == 0)
       delete mo;
   }
-  for (threads_ty::iterator it = threads.begin(); it != threads.end(); it++) {
-    Thread &t = it->second;
-    while (!t.stack.empty()) popFrame(t);
-  }
+  // The stacks are released with the threads, which may still be shared with
+  // other states
 }
 
 ExecutionState::ExecutionState(const ExecutionState& state):
@@ -119,14 +127,32 @@ ExecutionState::ExecutionState(const ExecutionState& state):
     stateTime(state.stateTime),
 
     threads(state.threads),
+    threadsCowKey(++state.threadsCowKey),
+    crtThreadCache(0),
+    crtThreadId(state.crtThreadId),
     waitingLists(state.waitingLists),
     wlistCounter(state.wlistCounter),
     preemptions(state.preemptions),
     schedulingHistory(state.schedulingHistory),
+    pctPriorities(state.pctPriorities),
+    pctChangePoints(state.pctChangePoints),
+    schedulePoints(state.schedulePoints),
+    sleepSet(state.sleepSet),
+    pendingSleep(state.pendingSleep),
+    transitionSynchronizes(state.transitionSynchronizes),
+    notifiedOther(state.notifiedOther),
+    lastNotifyFork(state.lastNotifyFork),
 
     raceCandidates(state.raceCandidates),
+    accessShadows(state.accessShadows),
     memoryAccesses(state.memoryAccesses),
-    logMemAccesses(state.logMemAccesses)
+    nextAccessEviction(state.nextAccessEviction),
+    lockOperations(state.lockOperations),
+    waitListOperations(state.waitListOperations),
+    syncClocks(state.syncClocks),
+    logMemAccesses(state.logMemAccesses),
+    unorderedConflicts(state.unorderedConflicts),
+    instsSinceNewRace(state.instsSinceNewRace)
 {
   for (unsigned int i=0; i<symbolics.size(); i++)
     symbolics[i].first->refCount++;
@@ -141,7 +167,6 @@ ExecutionState *ExecutionState::branch() {
 
   weight *= .5;
   falseState->weight -= weight;
-  falseState->crtThreadIt = falseState->threads.find(crtThreadIt->second.tid);
 
   return falseState;
 }
@@ -184,18 +209,36 @@ void ExecutionState::removeFnAlias(std::string fn) {
 }
 
 Thread& ExecutionState::createThread(Thread::thread_id_t tid, KFunction *kf) {
-  logMemAccesses = true;
-  Thread newThread = Thread(tid,  kf);
-  threads.insert(std::make_pair(newThread.tid, newThread));
-  return threads.find(tid)->second;
+  assert(!threads.count(tid) && "thread already exists");
+  if (!threads.empty())
+    logMemAccesses = true;
+  Thread *t = new Thread(tid, kf);
+  t->copyOnWriteOwner = threadsCowKey;
+  threads = threads.insert(std::make_pair(tid, ref<Thread>(t)));
+  return *t;
+}
+
+Thread &ExecutionState::getWriteableThread(Thread::thread_id_t tid) {
+  const threads_ty::value_type *res = threads.lookup(tid);
+  assert(res && "thread does not exist");
+
+  Thread *t = res->second.get();
+  if (t->copyOnWriteOwner != threadsCowKey) {
+    t = new Thread(*t);
+    t->copyOnWriteOwner = threadsCowKey;
+    threads = threads.replace(std::make_pair(tid, ref<Thread>(t)));
+  }
+  if (tid == crtThreadId)
+    crtThreadCache = t;
+  return *t;
 }
 
-void ExecutionState::terminateThread(threads_ty::iterator thrIt) {
+void ExecutionState::terminateThread(Thread::thread_id_t tid) {
   assert(threads.size() > 1);
-  assert(thrIt != crtThreadIt); // We assume the scheduler found a new thread first
-  assert(!thrIt->second.enabled);
-  assert(thrIt->second.waitingList == 0);
-  threads.erase(thrIt);
+  assert(tid != crtThreadId); // We assume the scheduler found a new thread first
+  assert(!getThread(tid).enabled);
+  assert(getThread(tid).waitingList == 0);
+  threads = threads.remove(tid);
 }
 
 void ExecutionState::sleepThread(Thread::wlist_id_t wlist) {
@@ -219,7 +262,7 @@ void ExecutionState::notifyOne(Thread::wlist_id_t wlist, Thread::thread_id_t tid
     assert(0 && "thread was not waiting");
   }
 
-  Thread &thread = threads.find(tid)->second;
+  Thread &thread = getWriteableThread(tid);
   assert(!thread.enabled);
   thread.enabled = true;
   thread.waitingList = 0;
@@ -235,7 +278,7 @@ void ExecutionState::notifyAll(Thread::wlist_id_t wlist) {
 
   if (wl.size() > 0) {
     for (std::set<Thread::thread_id_t>::iterator it = wl.begin(); it != wl.end(); it++) {
-      Thread &thread = threads.find(*it)->second;
+      Thread &thread = getWriteableThread(*it);
       thread.enabled = true;
       thread.waitingList = 0;
     }
@@ -464,17 +507,120 @@ void ExecutionState::dumpStack(llvm::raw_ostream &out) const {
 }
 
 void ExecutionState::updateVectorClock(Thread::thread_id_t tid, ref<VectorClock> vc) {
-  threads_ty::iterator res = threads.find(tid);
-  if (res != threads.end())
-    res->second.vc = vc;
-  return;
+  if (threads.count(tid))
+    getWriteableThread(tid).vc = vc;
+}
+
+void ExecutionState::acquireVectorClock(uint64_t sync) {
+  Thread &t = crtThread();
+  sync_clocks_t::iterator it = syncClocks.find(sync);
+  if (it != syncClocks.end())
+    t.vc = t.vc->join(*it->second);
+  t.vc = t.vc->tick(t.tid);
+}
+
+void ExecutionState::releaseVectorClock(uint64_t sync, bool merge) {
+  Thread &t = crtThread();
+  ref<VectorClock> &published = syncClocks[sync];
+  if (merge && !published.isNull())
+    published = published->join(*t.vc);
+  else
+    published = t.vc;
+  t.vc = t.vc->tick(t.tid);
+}
+
+void ExecutionState::forkVectorClock(Thread::thread_id_t tid) {
+  Thread &t = crtThread();
+  t.vc = t.vc->tick(t.tid);
+  getWriteableThread(tid).vc = t.vc->tick(tid);
+  t.vc = t.vc->tick(t.tid);
+}
+
+namespace {
+  struct InEvicted {
+    const std::set<const MemoryAccessEntry*> &evicted;
+
+    InEvicted(const std::set<const MemoryAccessEntry*> &_evicted)
+      : evicted(_evicted) {}
+
+    bool operator()(const ref<MemoryAccessEntry> &entry) const {
+      return evicted.count(entry.get());
+    }
+  };
+}
+
+void ExecutionState::removeAccesses(const std::set<const MemoryAccessEntry*> &evicted,
+                                    const std::set<MemoryObject::id_t> &objects) {
+  if (evicted.empty())
+    return;
+
+  memoryAccesses.erase(std::remove_if(memoryAccesses.begin(), memoryAccesses.end(),
+                                      InEvicted(evicted)),
+                       memoryAccesses.end());
+
+  for (std::set<MemoryObject::id_t>::const_iterator it = objects.begin(),
+       ie = objects.end(); it != ie; ++it) {
+    memory_access_shadow_t::iterator sit = accessShadows.find(*it);
+    if (sit != accessShadows.end()) {
+      sit->second.remove(evicted);
+      if (sit->second.empty())
+        accessShadows.erase(sit);
+    }
+
+    memory_access_register_t::iterator rit = raceCandidates.find(*it);
+    if (rit != raceCandidates.end()) {
+      std::vector<ref<MemoryAccessEntry> > &entries = rit->second;
+      entries.erase(std::remove_if(entries.begin(), entries.end(),
+                                   InEvicted(evicted)),
+                    entries.end());
+      if (entries.empty())
+        raceCandidates.erase(rit);
+    }
+  }
+}
+
+void ExecutionState::evictOrderedAccesses() {
+  std::set<const MemoryAccessEntry*> evicted;
+  std::set<MemoryObject::id_t> objects;
+  std::vector<Thread::thread_id_t>::size_type current = getSchedulingIndex();
+  for (std::deque<ref<MemoryAccessEntry> >::iterator it = memoryAccesses.begin(),
+       ie = memoryAccesses.end(); it != ie; ++it) {
+    const MemoryAccessEntry &entry = **it;
+    if (entry.getScheduleIndex() == current)
+      continue;
+
+    bool ordered = true;
+    for (threads_ty::iterator tit = threads.begin(), tie = threads.end();
+         tit != tie && ordered; ++tit)
+      ordered = entry.happensBefore(*tit->second->vc);
+
+    if (ordered) {
+      evicted.insert(&entry);
+      objects.insert(entry.getMemoryObjectId());
+    }
+  }
+  removeAccesses(evicted, objects);
+}
+
+void ExecutionState::evictOldestAccesses(size_t keep) {
+  std::set<const MemoryAccessEntry*> evicted;
+  std::set<MemoryObject::id_t> objects;
+  std::vector<Thread::thread_id_t>::size_type current = getSchedulingIndex();
+  for (std::deque<ref<MemoryAccessEntry> >::iterator it = memoryAccesses.begin(),
+       ie = memoryAccesses.end();
+       it != ie && memoryAccesses.size() - evicted.size() > keep; ++it) {
+    if ((*it)->getScheduleIndex() == current)
+      break;
+    evicted.insert(it->get());
+    objects.insert((*it)->getMemoryObjectId());
+  }
+  removeAccesses(evicted, objects);
 }
 
 void ExecutionState::updateLockset(Thread::thread_id_t tid, uint64_t lock_id,
                                    bool isAcquire, bool isWriteMode) {
-  threads_ty::iterator res = threads.find(tid);
-  if (res != threads.end()) {
-    Thread& t = res->second;
+  if (threads.count(tid)) {
+    Thread& t = getWriteableThread(tid);
     if (isAcquire) {
       t.lockset = t.getLockset()->insert(lock_id);
       t.writeLockset = isWriteMode? t.getWriteLockset()->insert(lock_id) : t.getWriteLockset();
@@ -24,6 +24,7 @@
 #include "UserSearcher.h"
 #include "ExecutorTimerInfo.h"
 #include "Thread.h"
+#include "RaceDetection.h"
 #include "RaceReport.h"
 
 #include "../Solver/SolverStats.h"
@@ -93,6 +94,7 @@
 
 #include <cassert>
 #include <algorithm>
+#include <functional>
 #include <iomanip>
 #include <iosfwd>
 #include <fstream>
@@ -103,6 +105,8 @@
 #include <sys/mman.h>
 
 #include <errno.h>
+#include <unistd.h>
+#include <sys/wait.h>
 #include <cxxabi.h>
 
 using namespace llvm;
@@ -279,6 +283,16 @@ namespace {
             cl::desc("Fork when various schedules are possible (default=off)"),
             cl::init(false));
 
+  cl::opt<bool>
+  UseDPOR("dpor",
+            cl::desc("Fork on schedule, but only explore the schedules that reorder dependent accesses or synchronizations (default=off)"),
+            cl::init(false));
+
+  cl::opt<bool>
+  UseSleepSets("sleep-sets",
+            cl::desc("Do not fork the schedules whose next transition is independent of an already explored one. Only the instrumented accesses are compared, and a preemption bound may prune schedules that are not equivalent, so use it with --instrument-all and --no-scheduler-bound (default=off)"),
+            cl::init(false));
+
   cl::opt<unsigned>
   MaxPreemptions("scheduler-preemption-bound",
             cl::desc("Scheduler preemption bound (default=0)"),
@@ -289,11 +303,66 @@ namespace {
             cl::desc("Do not bound the number of preemptions in the schedule (default=off)"),
             cl::init(false));
 
+  cl::opt<bool>
+  UsePCT("pct",
+            cl::desc("Do not fork on schedule, run the enabled thread with the highest random priority and lower it at --pct-depth - 1 random points (default=off)"),
+            cl::init(false));
+
+  cl::opt<unsigned>
+  PCTDepth("pct-depth",
+            cl::desc("Depth of the bugs targeted by --pct, one more than the number of priority change points (default=3)"),
+            cl::init(3));
+
+  cl::opt<unsigned>
+  PCTSchedSteps("pct-sched-steps",
+            cl::desc("Estimated number of scheduling steps of a path, the priority change points of --pct are drawn below it (default=100)"),
+            cl::init(100));
+
+  cl::opt<unsigned>
+  PCTTrials("pct-trials",
+            cl::desc("Number of times --pct runs the program, drawing new priorities each time (default=1)"),
+            cl::init(1));
+
+  cl::opt<unsigned>
+  RNGSeed("rng-seed",
+            cl::desc("Seed of the random number generator used by the searchers and --pct (default=5489)"),
+            cl::init(5489));
+
   cl::opt<bool>
   AllowPartialScheduling("allow-partial-scheduling",
             cl::desc("Allow to continue exploring interleavings after the total number of replay scheduling steps (--replay-out) have been consumed (default=off)"),
             cl::init(false));
 
+  cl::opt<unsigned>
+  ReplayExploreFrom("replay-explore-from",
+            cl::desc("Replay only this number of scheduling steps of the test case (--replay-out), then explore the interleavings from there (default=0 (replay every step))"),
+            cl::init(0));
+
+  cl::opt<bool>
+  ReplayFastForward("replay-fast-forward",
+            cl::desc("Replay the scheduling steps of the test case without logging memory accesses nor recording the steps in the process tree (default=off)"),
+            cl::init(false));
+
+  cl::opt<unsigned>
+  ParallelWorkers("parallel-workers",
+            cl::desc("Split the states among this number of worker processes once there are enough of them, the workers that run out of states then take over states of the others (default=1)"),
+            cl::init(1));
+
+  cl::opt<unsigned>
+  SchedulePartitionStates("sched-partition-states",
+            cl::desc("Export the states beyond this number as schedule prefixes to be explored by other processes (default=0 (off))"),
+            cl::init(0));
+
+  cl::opt<bool>
+  EvictOrderedAccesses("evict-ordered-accesses",
+            cl::desc("Drop the logged memory accesses that happen before every thread, as they cannot race anymore (default=on)"),
+            cl::init(true));
+
+  cl::opt<unsigned>
+  RaceHistorySize("race-history-size",
+            cl::desc("Maximum number of logged memory accesses per state, the oldest ones are dropped and races with them are missed (default=0 (unbounded))"),
+            cl::init(0));
+
   cl::opt<bool>
   DumpPtree("dump-ptree",
             cl::desc("Dump ptree at the end of the exploration (default=off)"),
@@ -329,11 +398,17 @@ Executor::Executor(const InterpreterOptions &opts,
     atMemoryLimit(false),
     inhibitForking(false),
     haltExecution(false),
+    workersForked(false),
+    pctInitialState(0),
+    pctTrials(0),
+    partitionThreshold(0),
     ivcEnabled(false),
     coreSolverTimeout(MaxCoreSolverTime != 0 && MaxInstructionTime != 0
       ? std::min(MaxCoreSolverTime,MaxInstructionTime)
       : std::max(MaxCoreSolverTime,MaxInstructionTime)) {
       
+  theRNG.seed(RNGSeed);
+
   if (coreSolverTimeout) UseForkedCoreSolver = true;
   
   Solver *coreSolver = NULL;
@@ -683,6 +758,8 @@ void Executor::branch(ExecutionState &state,
       ExecutionState *es = result[theRNG.getInt32() % i];
       ExecutionState *ns = es->branch();
       addedStates.insert(ns);
+      if (UseSleepSets)
+        markTransitionForked(*ns);
       result.push_back(ns);
       es->ptreeNode->data = 0;
       std::pair<PTree::Node*,PTree::Node*> res = 
@@ -903,6 +980,8 @@ Executor::fork(ExecutionState &current, ref<Expr> condition, bool isInternal,
 
     falseState = trueState->branch();
     addedStates.insert(falseState);
+    if (UseSleepSets)
+      markTransitionForked(*falseState);
 
     if (RandomizeFork && theRNG.getBool())
       std::swap(trueState, falseState);
@@ -981,6 +1060,9 @@ Executor::StatePair Executor::fork(ExecutionState &current, ForkType reason, boo
   ExecutionState *newState = NULL;
 
   if(!isFake) {
+    // Only the alternative schedules are attributed to the preemption points
+    if (reason == KLEE_FORK_SCHEDULE || reason == KLEE_FORK_MULTI)
+      ++stats::scheduleForks;
     newState = lastState->branch();
     addedStates.insert(newState);
   }
@@ -1231,6 +1313,8 @@ void Executor::stepInstruction(ExecutionState &state) {
     statsTracker->stepInstruction(state);
 
   ++stats::instructions;
+  if (state.instsSinceNewRace)
+    ++state.instsSinceNewRace;
   state.prevPC() = state.pc();
   ++state.pc();
 
@@ -1711,6 +1795,19 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
 
     unsigned numArgs = cs.arg_size();
     Value *fp = cs.getCalledValue();
+
+    // Instrumented accesses skip the generic call path. KFunction only
+    // decodes the calls, the invokes also have to continue to their
+    // normal destination.
+    if (fp == kmodule->kleeMemAccessFn && isa<CallInst>(i)) {
+      KMemAccessInstruction *kmi = static_cast<KMemAccessInstruction*>(ki);
+      if (kmi->decoded) {
+        executeMemoryAccess(state, ki, eval(ki, 1, state).value, kmi->bytes,
+                            kmi->isWrite, kmi->isAtomic, kmi->isRaceCandidate);
+        break;
+      }
+    }
+
     Function *f = getTargetFunction(fp, state);
 
     // Skip debug intrinsics, we can't evaluate their metadata arguments.
@@ -2511,6 +2608,8 @@ void Executor::updateStates(ExecutionState *current) {
       seedMap.find(es);
     if (it3 != seedMap.end())
       seedMap.erase(it3);
+    if (UseDPOR)
+      discardSchedulePoints(*es);
     if (!ConservePtreeNodes)
       processTree->remove(es->ptreeNode);
     else
@@ -2591,6 +2690,33 @@ void Executor::run(ExecutionState &initialState) {
 
   states.insert(&initialState);
 
+  if (UsePCT) {
+    if (ForkOnSchedule || UseDPOR || UseSleepSets)
+      klee_error("--pct is not compatible with --fork-on-schedule, --dpor or --sleep-sets");
+    if (PCTDepth == 0 || PCTTrials == 0)
+      klee_error("--pct-depth and --pct-trials must be positive");
+    // The following trials start from an untouched copy of the initial
+    // state. It is kept out of the process tree, like the parked schedules
+    // of DPOR, so the searchers cannot select it.
+    if (PCTTrials > 1) {
+      pctInitialState = initialState.branch();
+      pctInitialState->ptreeNode = 0;
+    }
+    pctTrials = 1;
+    initPCT(initialState);
+  }
+
+  if (UseSleepSets) {
+    // The footprints only hold the accesses logged by the instrumentation
+    klee_warning_once(&UseSleepSets,
+                      "--sleep-sets treats the transitions as independent unless "
+                      "their instrumented accesses conflict, use --instrument-all");
+    if (!NoMaxPreemptions && !userSearcherUnboundedPreemptions())
+      klee_warning_once(&NoMaxPreemptions,
+                        "--sleep-sets may prune schedules that are not equivalent "
+                        "under a preemption bound, use --no-scheduler-bound");
+  }
+
   if (usingSeeds) {
     std::vector<SeedInfo> &v = seedMap[&initialState];
     
@@ -2656,6 +2782,7 @@ void Executor::run(ExecutionState &initialState) {
   }
 
   searcher = constructUserSearcher(*this);
+  partitionThreshold = SchedulePartitionStates;
 
   searcher->update(0, states, std::set<ExecutionState*>());
 
@@ -2702,10 +2829,29 @@ void Executor::run(ExecutionState &initialState) {
     }
 
     updateStates(&state);
+
+    if (states.empty() && pctInitialState)
+      startPCTTrial();
+
+    if (ParallelWorkers > 1 && !workersForked &&
+        states.size() >= ParallelWorkers)
+      forkWorkers();
+
+    if (SchedulePartitionStates && states.size() > partitionThreshold)
+      exportSchedulePrefixes(SchedulePartitionStates);
+
+    // Hand half of the states over to the workers that ran out of them
+    if (workersForked && (stats::instructions & 0xFFFF) == 0 &&
+        states.size() > 1 && interpreterHandler->hasIdleWorkers())
+      exportSchedulePrefixes(states.size() / 2);
   }
 
   delete searcher;
   searcher = 0;
+
+  if (UseDPOR || UseSleepSets)
+    klee_message("pruned %lu equivalent schedules",
+                 (unsigned long) stats::prunedSchedules.getValue());
   
  dump:
   if (DumpStatesOnHalt && !states.empty()) {
@@ -2719,6 +2865,202 @@ void Executor::run(ExecutionState &initialState) {
     }
     updateStates(0);
   }
+
+  if (pctInitialState) {
+    delete pctInitialState;
+    pctInitialState = 0;
+  }
+}
+
+void Executor::forkWorkers() {
+  workersForked = true;
+
+  RaceReport::shareEmittedReports();
+
+  interpreterHandler->getInfoStream().flush();
+  llvm::outs().flush();
+  llvm::errs().flush();
+  fflush(stdout);
+  fflush(stderr);
+
+  // Partitions of the states explored by this process; the partitions of the
+  // workers that could not be forked stay in the parent
+  std::set<unsigned> partitions;
+  partitions.insert(0);
+  for (unsigned i = 1; i < ParallelWorkers; ++i) {
+    int pid = ::fork();
+    if (pid < 0) {
+      klee_warning("unable to fork worker %u: %s", i, strerror(errno));
+      partitions.insert(i);
+    } else if (pid == 0) {
+      partitions.clear();
+      partitions.insert(i);
+      workerPids.clear();
+      if (statsTracker)
+        statsTracker->setWorker(i);
+      interpreterHandler->setWorker(i, ParallelWorkers);
+      break;
+    } else {
+      workerPids.push_back(pid);
+    }
+  }
+  if (partitions.count(0))
+    interpreterHandler->setWorker(0, ParallelWorkers);
+
+  // States are sorted by address, which is the same in every worker. The
+  // states sharing a schedule point stay in the same worker, as any of them
+  // may resume the alternatives parked in it. The points are inherited, so
+  // such states also share the first point of their paths.
+  std::map<SchedulePoint*, unsigned> groups;
+  unsigned index = 0;
+  for (std::set<ExecutionState*>::iterator it = states.begin(),
+       ie = states.end(); it != ie; ++it) {
+    ExecutionState *es = *it;
+    SchedulePoint *first = 0;
+    for (unsigned i = 0; i != es->schedulePoints.size() && !first; ++i)
+      first = es->schedulePoints[i].get();
+
+    unsigned group;
+    if (first) {
+      std::map<SchedulePoint*, unsigned>::iterator git = groups.find(first);
+      if (git == groups.end())
+        git = groups.insert(std::make_pair(first, index++)).first;
+      group = git->second;
+    } else {
+      group = index++;
+    }
+    if (partitions.count(group % ParallelWorkers))
+      continue;
+
+    // The alternatives parked in the points of the other workers are
+    // explored there, so they are not pruned schedules
+    for (unsigned i = 0; i != es->schedulePoints.size(); ++i) {
+      SchedulePoint *point = es->schedulePoints[i].get();
+      if (!point)
+        continue;
+      for (SchedulePoint::parked_ty::iterator pit = point->parked.begin(),
+           pie = point->parked.end(); pit != pie; ++pit)
+        delete pit->second;
+      point->parked.clear();
+    }
+    removedStates.insert(es);
+  }
+  klee_message("worker %u exploring %u states", *partitions.begin(),
+               (unsigned) (states.size() - removedStates.size()));
+  updateStates(0);
+}
+
+void Executor::waitWorkers() {
+  for (std::vector<int>::iterator it = workerPids.begin(),
+       ie = workerPids.end(); it != ie; ++it) {
+    int status;
+    pid_t res;
+    do {
+      res = waitpid(*it, &status, 0);
+    } while (res < 0 && errno == EINTR);
+
+    if (res < 0)
+      klee_warning("waitpid() for worker failed: %s", strerror(errno));
+    else if (!WIFEXITED(status) || WEXITSTATUS(status))
+      klee_warning("worker %d did not finish successfully", *it);
+  }
+  workerPids.clear();
+}
+
+namespace {
+  struct DeeperState {
+    bool operator()(const ExecutionState *a, const ExecutionState *b) const {
+      return a->depth > b->depth;
+    }
+  };
+}
+
+bool Executor::canExportSchedulePrefix(const ExecutionState &state) {
+  // The replay wakes the first waiter without forking, so the state must
+  // have done the same, including in the transition it is exported in
+  if (state.notifiedOther ||
+      state.lastNotifyFork == state.getSchedulingIndex() + 1)
+    return false;
+
+  // The alternatives parked in a shared point may have to be resumed from
+  // the exported subtree, which this process would not see anymore
+  for (unsigned i = 0; i != state.schedulePoints.size(); ++i) {
+    SchedulePoint *point = state.schedulePoints[i].get();
+    if (point && point->refCount > 1)
+      return false;
+  }
+
+  if (state.symbolics.empty())
+    return true;
+
+  // The prefix is replayed with a single input, so any other input allowed
+  // by the path would not be explored
+  std::vector<const Array*> objects;
+  for (unsigned i = 0; i != state.symbolics.size(); ++i)
+    objects.push_back(state.symbolics[i].second);
+  std::vector< std::vector<unsigned char> > values;
+
+  solver->setTimeout(coreSolverTimeout);
+  bool unique = false;
+  bool success = solver->getInitialValues(state, objects, values);
+  if (success) {
+    ref<Expr> same = ConstantExpr::alloc(1, Expr::Bool);
+    for (unsigned i = 0; i != objects.size(); ++i) {
+      UpdateList ul(objects[i], 0);
+      for (unsigned j = 0; j != values[i].size(); ++j)
+        same = AndExpr::create(same,
+                               EqExpr::create(ReadExpr::create(ul, ConstantExpr::alloc(j, Expr::Int32)),
+                                              ConstantExpr::alloc(values[i][j], Expr::Int8)));
+    }
+    success = solver->mustBeTrue(state, same, unique);
+  }
+  solver->setTimeout(0);
+  return success && unique;
+}
+
+void Executor::exportSchedulePrefixes(unsigned keep) {
+  if (states.size() <= keep)
+    return;
+
+  // Keep exploring the deepest states and hand over the shallowest ones: they
+  // are the cheapest to replay and have the largest subtrees left below them
+  std::vector<ExecutionState*> candidates(states.begin(), states.end());
+  std::nth_element(candidates.begin(), candidates.begin() + keep,
+                   candidates.end(), DeeperState());
+
+  unsigned exported = 0, kept = 0;
+  bool failed = false;
+  for (unsigned i = keep; i < candidates.size(); ++i) {
+    ExecutionState *es = candidates[i];
+    if (!canExportSchedulePrefix(*es)) {
+      ++kept;
+      continue;
+    }
+    if (!interpreterHandler->exportSchedulePrefix(*es)) {
+      failed = true;
+      break;
+    }
+    removedStates.insert(es);
+    ++exported;
+  }
+
+  if (failed && !exported) {
+    klee_warning_once(&SchedulePartitionStates,
+                      "unable to export schedule prefixes, disabling partitioning");
+    SchedulePartitionStates = 0;
+    return;
+  }
+
+  if (kept)
+    klee_warning_once(&partitionThreshold,
+                      "keeping the states whose inputs are not fixed by their path, "
+                      "that woke a thread other than the first waiter, or that share "
+                      "schedule points with other states, as their schedule prefix "
+                      "would not explore the same schedules");
+
+  stats::exportedSchedules += exported;
+  updateStates(0);
+  partitionThreshold = std::max((size_t) SchedulePartitionStates, states.size());
 }
 
 std::string Executor::getAddressInfo(ExecutionState &state, 
@@ -2777,7 +3119,7 @@ void Executor::terminateState(ExecutionState &state) {
                       "replay did not consume all objects in test input.");
   }
 
-  if (replayOut && replaySched < replayOut->numSchedSteps) {
+  if (replayOut && replaySched < getReplayScheduleSteps()) {
     klee_warning_once(replayOut,
                       "replay did not consume all scheduling steps in test input");
   }
@@ -2815,7 +3157,9 @@ void Executor::terminateStateEarly(ExecutionState &state,
     std::string Str;
     llvm::raw_string_ostream msg(Str);
     msg << "Explored schedule: ";
-    for (std::vector<Thread::thread_id_t>::iterator it = state.schedulingHistory.begin(); it != state.schedulingHistory.end(); ++it)
+    SchedulingHistory::steps_ty steps;
+    state.schedulingHistory.getSteps(steps);
+    for (SchedulingHistory::steps_ty::iterator it = steps.begin(); it != steps.end(); ++it)
        msg << *it << ' ';
     klee_message("%s", msg.str().c_str());
   }
@@ -2835,7 +3179,9 @@ void Executor::terminateStateOnExit(ExecutionState &state) {
     std::string Str;
     llvm::raw_string_ostream msg(Str);
     msg << "Explored schedule: ";
-    for (std::vector<Thread::thread_id_t>::iterator it = state.schedulingHistory.begin(); it != state.schedulingHistory.end(); ++it)
+    SchedulingHistory::steps_ty steps;
+    state.schedulingHistory.getSteps(steps);
+    for (SchedulingHistory::steps_ty::iterator it = steps.begin(); it != steps.end(); ++it)
        msg << *it << ' ';
     klee_message("%s", msg.str().c_str());
   }
@@ -2929,7 +3275,9 @@ void Executor::terminateStateOnError(ExecutionState &state,
     std::string Str;
     llvm::raw_string_ostream msg(Str);
     msg << "Explored schedule: ";
-    for (std::vector<Thread::thread_id_t>::iterator it = state.schedulingHistory.begin(); it != state.schedulingHistory.end(); ++it)
+    SchedulingHistory::steps_ty steps;
+    state.schedulingHistory.getSteps(steps);
+    for (SchedulingHistory::steps_ty::iterator it = steps.begin(); it != steps.end(); ++it)
        msg << *it << ' ';
     klee_message("%s", msg.str().c_str());
   }
@@ -3718,6 +4066,84 @@ Expr::Width Executor::getWidthForLLVMType(LLVM_TYPE_Q llvm::Type *type) const {
   return kmodule->targetData->getTypeSizeInBits(type);
 }
 
+void Executor::initPCT(ExecutionState &state) {
+  state.pctPriorities.clear();
+  state.pctChangePoints.clear();
+  for (unsigned i = 1; i < PCTDepth; ++i)
+    state.pctChangePoints.push_back(1 + theRNG.getInt32() % std::max((unsigned) PCTSchedSteps, 1U));
+  std::sort(state.pctChangePoints.begin(), state.pctChangePoints.end(),
+            std::greater<SchedulingHistory::size_type>());
+}
+
+void Executor::startPCTTrial() {
+  if (pctTrials == PCTTrials || haltExecution) {
+    delete pctInitialState;
+    pctInitialState = 0;
+    return;
+  }
+
+  ++pctTrials;
+  klee_message("starting PCT trial %u of %u", pctTrials, (unsigned) PCTTrials);
+
+  // The nodes of the previous trial went away with its last state, so the
+  // trial roots a new process tree
+  ExecutionState *trial = pctInitialState->branch();
+  delete processTree;
+  processTree = new PTree(trial);
+  trial->ptreeNode = processTree->root;
+  initPCT(*trial);
+
+  addedStates.insert(trial);
+  updateStates(0);
+}
+
+void Executor::schedulePCT(ExecutionState &state, Thread::thread_id_t oldTid,
+                           bool yield) {
+  // The change points lower the running thread below every initial priority,
+  // the i-th one to PCTDepth - i
+  SchedulingHistory::size_type index = state.getSchedulingIndex() + 1;
+  while (!state.pctChangePoints.empty() && state.pctChangePoints.back() <= index) {
+    state.pctChangePoints.pop_back();
+    state.pctPriorities[oldTid] = state.pctChangePoints.size() + 1;
+  }
+
+  bool found = false;
+  Thread::thread_id_t tid = oldTid;
+  unsigned priority = 0;
+  std::set<Thread::thread_id_t> enabled = state.enabledThreadIds();
+  for (std::set<Thread::thread_id_t>::iterator it = enabled.begin(),
+       ie = enabled.end(); it != ie; ++it) {
+    // A yielding thread only runs again if no other thread can
+    if (yield && *it == oldTid && enabled.size() > 1)
+      continue;
+    std::map<Thread::thread_id_t, unsigned>::iterator pit =
+      state.pctPriorities.find(*it);
+    if (pit == state.pctPriorities.end())
+      pit = state.pctPriorities.insert(std::make_pair(*it,
+              PCTDepth + (theRNG.getInt32() >> 1))).first;
+    if (!found || pit->second > priority) {
+      found = true;
+      tid = *it;
+      priority = pit->second;
+    }
+  }
+
+  if (tid != oldTid && state.getThread(oldTid).enabled && !yield)
+    state.preemptions++;
+  state.schedulingHistory.push_back(tid);
+  state.scheduleNext(tid);
+}
+
+unsigned Executor::getReplayScheduleSteps() const {
+  if (ReplayExploreFrom && ReplayExploreFrom < replayOut->numSchedSteps)
+    return ReplayExploreFrom;
+  return replayOut->numSchedSteps;
+}
+
+bool Executor::isFastForwarding() const {
+  return ReplayFastForward && replayOut && replaySched < getReplayScheduleSteps();
+}
+
 bool Executor::schedule(ExecutionState &state, bool yield, bool terminateThread) {
   if (state.enabledThreadIds().empty()) {
     terminateStateOnError(state, " ******** hang (possible deadlock?)", "user.err");
@@ -3726,82 +4152,108 @@ bool Executor::schedule(ExecutionState &state, bool yield, bool terminateThread)
 
   bool forkSchedule = false;
   bool incPreemptions = false;
-  ExecutionState::threads_ty::iterator oldIt = state.crtThreadIt;
-  Thread::thread_id_t oldTid = oldIt->second.tid;
+  Thread::thread_id_t oldTid = state.crtThreadId;
+
+  if (UseSleepSets)
+    updateSleepSet(state, oldTid);
 
   bool scheduled = false;
   if (replayOut) {
-    if (!AllowPartialScheduling && (replaySched >= replayOut->numSchedSteps)) {
+    // The parallel workers replay the schedule prefixes handed over by the
+    // others, then explore from there
+    bool allowPartial = AllowPartialScheduling || ReplayExploreFrom ||
+                        interpreterOpts.AllowPartialScheduling || workersForked;
+    unsigned replaySteps = getReplayScheduleSteps();
+    // The replayed steps are not recorded in the process tree when fast
+    // forwarding, as there is nothing to explore from them
+    bool record = !isFastForwarding();
+    if (!allowPartial && (replaySched >= replaySteps)) {
       terminateStateOnError(state, "replay sched count mismatch", "user.err");
       return false;
-    } else if (replaySched < replayOut->numSchedSteps) {
+    } else if (replaySched < replaySteps) {
       unsigned long nextTid = replayOut->schedSteps[replaySched];
-      klee_message("replay next tid %lu", nextTid);
+      if (record)
+        klee_message("replay next tid %lu", nextTid);
       if (oldTid == nextTid) {
-        state.ptreeNode->enabled = state.enabledThreadIds();
-        fork(state, KLEE_FORK_SCHEDULE, true);
-        state.schedulingHistory.push_back(oldIt->first);
-        state.scheduleNext(oldIt); // The current thread stays as current
-        state.ptreeNode->tid = state.crtThread().getTid();
-        state.ptreeNode->schedulingIndex = state.getSchedulingIndex();
+        if (record) {
+          state.ptreeNode->enabled = state.enabledThreadIds();
+          fork(state, KLEE_FORK_SCHEDULE, true);
+        }
+        state.schedulingHistory.push_back(oldTid);
+        state.scheduleNext(oldTid); // The current thread stays as current
+        if (record) {
+          state.ptreeNode->tid = state.crtThread().getTid();
+          state.ptreeNode->schedulingIndex = state.getSchedulingIndex();
+        }
       } else {
-        ExecutionState::threads_ty::iterator finalIt = state.crtThreadIt;
-        ExecutionState::threads_ty::iterator it = state.nextThread(finalIt);
-        while ((it != finalIt) && (it->second.tid != nextTid))
-          it = state.nextThread(it);
+        Thread::thread_id_t finalTid = state.crtThreadId;
+        Thread::thread_id_t tid = state.nextThread(finalTid);
+        while ((tid != finalTid) && (tid != nextTid))
+          tid = state.nextThread(tid);
 
-        if (it == finalIt) {
+        if (tid == finalTid) {
           terminateStateOnError(state, "replay next thread not found", "user.err");
           return false;
-        } else if (!it->second.enabled) {
+        } else if (!state.getThread(tid).enabled) {
           terminateStateOnError(state, "replay next thread is not enabled", "user.err");
           return false;
         }
-        state.ptreeNode->enabled = state.enabledThreadIds();
-        fork(state, KLEE_FORK_SCHEDULE, true);
-        state.schedulingHistory.push_back(it->first);
-        state.scheduleNext(it);
-        state.ptreeNode->tid = state.crtThread().getTid();
-        state.ptreeNode->schedulingIndex = state.getSchedulingIndex();
+        // Account the replayed preemptions, so the exploration that follows
+        // the prefix stays within the same bound
+        if (state.getThread(oldTid).enabled && !yield)
+          state.preemptions++;
+        if (record) {
+          state.ptreeNode->enabled = state.enabledThreadIds();
+          fork(state, KLEE_FORK_SCHEDULE, true);
+        }
+        state.schedulingHistory.push_back(tid);
+        state.scheduleNext(tid);
+        if (record) {
+          state.ptreeNode->tid = state.crtThread().getTid();
+          state.ptreeNode->schedulingIndex = state.getSchedulingIndex();
+        }
       }
       replaySched++;
       scheduled = true;
-    } else if (replaySched == replayOut->numSchedSteps) {
+    } else if (replaySched == replaySteps) {
       klee_message("replay scheduling steps exhausted, start default scheduling");
       replaySched++;
     }
   }
 
-  if (!scheduled) {
+  if (!scheduled && UsePCT) {
+    schedulePCT(state, oldTid, yield);
+  } else if (!scheduled) {
     if (!state.crtThread().enabled || yield) {
-      ExecutionState::threads_ty::iterator it = state.nextThread(state.crtThreadIt);
+      Thread::thread_id_t tid = state.nextThread(state.crtThreadId);
 
-      while (!it->second.enabled)
-        it = state.nextThread(it);
+      while (!state.getThread(tid).enabled)
+        tid = state.nextThread(tid);
 
-      if (ForkOnSchedule) {
+      if (ForkOnSchedule || UseDPOR) {
         forkSchedule = true;
-        state.schedulingHistory.push_back(it->first);
-        state.scheduleNext(it);
+        state.schedulingHistory.push_back(tid);
+        state.scheduleNext(tid);
       } else {
         state.ptreeNode->enabled = state.enabledThreadIds();
         fork(state, KLEE_FORK_SCHEDULE, true);
-        state.schedulingHistory.push_back(it->first);
-        state.scheduleNext(it);
+        state.schedulingHistory.push_back(tid);
+        state.scheduleNext(tid);
         state.ptreeNode->tid = state.crtThread().getTid();
         state.ptreeNode->schedulingIndex = state.getSchedulingIndex();
       }
     } else {
-      if (NoMaxPreemptions || state.preemptions < MaxPreemptions) {
+      if (NoMaxPreemptions || userSearcherUnboundedPreemptions() ||
+          state.preemptions < MaxPreemptions) {
         forkSchedule = true;
         incPreemptions = true;
-        state.schedulingHistory.push_back(oldIt->first);
-        state.scheduleNext(oldIt); // The current thread stays as current
+        state.schedulingHistory.push_back(oldTid);
+        state.scheduleNext(oldTid); // The current thread stays as current
       } else {
         state.ptreeNode->enabled = state.enabledThreadIds();
         fork(state, KLEE_FORK_SCHEDULE, true);
-        state.schedulingHistory.push_back(oldIt->first);
-        state.scheduleNext(oldIt); // The current thread stays as current
+        state.schedulingHistory.push_back(oldTid);
+        state.scheduleNext(oldTid); // The current thread stays as current
         state.ptreeNode->tid = state.crtThread().getTid();
         state.ptreeNode->schedulingIndex = state.getSchedulingIndex();
       }
@@ -3809,7 +4261,7 @@ bool Executor::schedule(ExecutionState &state, bool yield, bool terminateThread)
   }
 
   if (terminateThread)
-    state.terminateThread(oldIt);
+    state.terminateThread(oldTid);
 
   if (DebugSchedulingHistory) {
     unsigned int depth = state.stack().size() - 1;
@@ -3822,17 +4274,36 @@ bool Executor::schedule(ExecutionState &state, bool yield, bool terminateThread)
   }
 
   if (forkSchedule) {
-    ExecutionState::threads_ty::iterator finalIt = state.crtThreadIt;
-    ExecutionState::threads_ty::iterator it = state.nextThread(finalIt);
+    // The point is shared with the alternative schedules forked below
+    ref<SchedulePoint> point;
+    if (UseDPOR || UseSleepSets) {
+      point = SchedulePoint::create(state.enabledThreadIds());
+      state.schedulePoints.resize(state.getSchedulingIndex());
+      state.schedulePoints.back() = point;
+    }
+
+    Thread::thread_id_t finalTid = state.crtThreadId;
+    Thread::thread_id_t tid = state.nextThread(finalTid);
     ExecutionState *lastState = &state;
     ForkType reason = KLEE_FORK_SCHEDULE;
     bool addFalseFork = true;
-    while (it != finalIt) {
+    // Threads explored before the alternative being forked
+    std::set<Thread::thread_id_t> explored;
+    explored.insert(state.crtThread().getTid());
+    while (tid != finalTid) {
       // Choose only enabled states, and, in the case of yielding, do not
       // reschedule the same thread
-      if (it->second.enabled && (!yield || it->second.tid != oldTid)) {
+      if (state.getThread(tid).enabled && (!yield || tid != oldTid)) {
+        // Asleep threads lead to a schedule equivalent to an explored one
+        if (UseSleepSets && state.sleepSet.count(tid)) {
+          ++stats::prunedSchedules;
+          tid = state.nextThread(tid);
+          continue;
+        }
+
         addFalseFork = false;
         lastState->ptreeNode->enabled = lastState->enabledThreadIds();
+        lastState->ptreeNode->sleeping = lastState->sleepingThreadIds();
         StatePair sp = fork(*lastState, reason, false);
 
         if (incPreemptions)
@@ -3841,11 +4312,19 @@ bool Executor::schedule(ExecutionState &state, bool yield, bool terminateThread)
         sp.first->schedulingHistory.pop_back();
         // The last sched step has been introduced automatically but
         // do not refer to the original thread, at the beginning of the method
-        sp.first->scheduleNext(sp.first->threads.find(it->second.tid));
-        sp.first->schedulingHistory.push_back(it->second.tid);
+        sp.first->scheduleNext(tid);
+        sp.first->schedulingHistory.push_back(tid);
         sp.first->ptreeNode->tid = sp.first->crtThread().getTid();
         sp.first->ptreeNode->schedulingIndex = sp.first->getSchedulingIndex();
 
+        // Parked schedules may never be explored, so only the current
+        // thread can be put to sleep with DPOR
+        if (UseSleepSets) {
+          sp.first->pendingSleep = explored;
+          if (!UseDPOR)
+            explored.insert(tid);
+        }
+
         if (DebugSchedulingHistory) {
           unsigned int depth = sp.first->stack().size() - 1;
           std::string Str;
@@ -3858,13 +4337,22 @@ bool Executor::schedule(ExecutionState &state, bool yield, bool terminateThread)
           klee_message("%s", msg.str().c_str());
         }
 
-        lastState = sp.first;
+        if (UseDPOR) {
+          // Park the alternative out of the process tree until a dependency
+          // requires exploring it
+          addedStates.erase(sp.first);
+          processTree->remove(sp.first->ptreeNode);
+          sp.first->ptreeNode = 0;
+          point->parked[tid] = sp.first;
+        } else {
+          lastState = sp.first;
+        }
 
         if (reason == KLEE_FORK_SCHEDULE)
           reason = KLEE_FORK_MULTI;   // Avoid appearing like multiple schedules
       }
 
-      it = state.nextThread(it);
+      tid = state.nextThread(tid);
     }
     // Only needed in the case of a forkSchedule but there is only one context switch
     if (addFalseFork) {
@@ -3874,9 +4362,62 @@ bool Executor::schedule(ExecutionState &state, bool yield, bool terminateThread)
       state.ptreeNode->schedulingIndex = state.getSchedulingIndex();
     }
   }
+
+  if (UseDPOR || UseSleepSets)
+    state.schedulePoints.resize(state.getSchedulingIndex());
   return true;
 }
 
+void Executor::updateSleepSet(ExecutionState &state, Thread::thread_id_t tid) {
+  std::vector<Thread::thread_id_t>::size_type index = state.getSchedulingIndex();
+
+  // Footprint of the transition just finished
+  TransitionFootprint footprint;
+  for (std::deque<ref<MemoryAccessEntry> >::reverse_iterator it = state.memoryAccesses.rbegin(),
+       ite = state.memoryAccesses.rend(); it != ite && (*it)->getScheduleIndex() == index; ++it)
+    footprint.accesses.push_back(*it);
+  footprint.dependsOnAll = state.transitionSynchronizes;
+  state.transitionSynchronizes = false;
+
+  SchedulePoint *point = 0;
+  if (index > 0 && index <= state.schedulePoints.size())
+    point = state.schedulePoints[index-1].get();
+
+  if (point) {
+    point->footprints[tid].merge(footprint);
+
+    // The threads explored before this one from the point are now asleep
+    for (std::set<Thread::thread_id_t>::iterator it = state.pendingSleep.begin(),
+         ite = state.pendingSleep.end(); it != ite; ++it) {
+      std::map<Thread::thread_id_t, TransitionFootprint>::const_iterator fit =
+          point->footprints.find(*it);
+      if (fit != point->footprints.end())
+        state.sleepSet[*it] = &fit->second;
+    }
+  }
+  state.pendingSleep.clear();
+
+  // Wake up the threads dependent with the transition
+  state.sleepSet.erase(tid);
+  for (ExecutionState::sleep_set_t::iterator it = state.sleepSet.begin(),
+       ite = state.sleepSet.end(); it != ite;) {
+    if (!it->second->isIndependent(footprint))
+      state.sleepSet.erase(it++);
+    else
+      ++it;
+  }
+}
+
+void Executor::markTransitionForked(ExecutionState &state) {
+  std::vector<Thread::thread_id_t>::size_type index = state.getSchedulingIndex();
+  if (index == 0 || index > state.schedulePoints.size())
+    return;
+
+  // The sibling schedules can not rely on the footprint of a single path
+  if (SchedulePoint *point = state.schedulePoints[index-1].get())
+    point->footprints[state.crtThread().getTid()].dependsOnAll = true;
+}
+
 void Executor::executeThreadCreate(ExecutionState &state, Thread::thread_id_t tid,
                                    ref<Expr> start_function, ref<Expr> arg) {
   KFunction *kf = resolveFunction(start_function);
@@ -3885,10 +4426,11 @@ void Executor::executeThreadCreate(ExecutionState &state, Thread::thread_id_t ti
   std::string Str;
   llvm::raw_string_ostream msg(Str);
   msg << "Creating thread: " << tid  << " Function: "
-      << kf->function->getName().str() << " Parent: " << state.crtThreadIt->second.tid;
+      << kf->function->getName().str() << " Parent: " << state.crtThreadId;
   klee_message("%s", msg.str().c_str());
 
   Thread &t = state.createThread(tid, kf);
+  state.transitionSynchronizes = true;
 
   bindArgumentThreadCreate(kf, 0, t.stack.back(), arg);
 
@@ -3898,7 +4440,7 @@ void Executor::executeThreadCreate(ExecutionState &state, Thread::thread_id_t ti
 
 void Executor::executeThreadExit(ExecutionState &state) {
   //terminate this thread and schedule another one
-  klee_message("Exiting thread: %lu", state.crtThreadIt->second.tid);
+  klee_message("Exiting thread: %lu", state.crtThreadId);
 
   if (state.threads.size() == 1) {
     klee_message("Terminating state");
@@ -3908,8 +4450,7 @@ void Executor::executeThreadExit(ExecutionState &state) {
 
   assert(state.threads.size() > 1);
 
-  ExecutionState::threads_ty::iterator thrIt = state.crtThreadIt;
-  thrIt->second.enabled = false;
+  state.crtThread().enabled = false;
 
   schedule(state, false, true);
 }
@@ -3919,7 +4460,10 @@ void Executor::executeThreadNotifyOne(ExecutionState &state,
   // Copy the waiting list
   std::set<Thread::thread_id_t> wl = state.waitingLists[wlist];
 
-  if (!ForkOnSchedule || wl.size() <= 1) {
+  // A replayed schedule wakes the first waiter without forking the other
+  // alternatives, which were explored by the process exporting it
+  bool replaying = replayOut && replaySched < getReplayScheduleSteps();
+  if (!ForkOnSchedule || wl.size() <= 1 || replaying) {
     if (wl.size() == 0)
       state.waitingLists.erase(wlist);
     else
@@ -3928,6 +4472,8 @@ void Executor::executeThreadNotifyOne(ExecutionState &state,
     return;
   }
 
+  state.lastNotifyFork = state.getSchedulingIndex() + 1;
+
   ExecutionState *lastState = &state;
   ForkType reason = KLEE_FORK_INTERNAL; // TODO treat similar to schedule
   for (std::set<Thread::thread_id_t>::iterator it = wl.begin(); it != wl.end();) {
@@ -3935,6 +4481,9 @@ void Executor::executeThreadNotifyOne(ExecutionState &state,
 
     if (it != wl.end()) {
       StatePair sp = fork(*lastState, reason, false);
+      if (UseSleepSets)
+        markTransitionForked(*sp.first);
+      sp.first->notifiedOther = true;
 
       sp.second->notifyOne(wlist, tid);
 
@@ -3960,15 +4509,49 @@ void Executor::bindArgumentThreadCreate(KFunction *kf, unsigned index,
   getArgumentCell(sf, kf, index).value = value;
 }
 
-void Executor::logMemoryAccess(ExecutionState &state, ref<Expr> address, unsigned bytes,
+void Executor::executeMemoryAccess(ExecutionState &state, KInstruction *target,
+                                   ref<Expr> address, unsigned bytes,
+                                   bool isWrite, bool isAtomic, bool isRaceCandidate) {
+  if (isFastForwarding() || !bytes)
+    return;
+
+  address = toUnique(state, address);
+
+  // Concrete addresses are resolved and bounds checked without the solver
+  if (ConstantExpr *CE = dyn_cast<ConstantExpr>(address)) {
+    ObjectPair op;
+    if (!state.addressSpace.resolveOne(CE, op))
+      return;
+    assert(cast<ConstantExpr>(op.first->getBoundsCheckPointer(address, bytes))->isTrue() &&
+           "XXX array size out of bounds");
+    // The logged length is inclusive, as for klee_mem_access_range
+    logMemoryAccess(state, address, bytes - 1, isWrite, isAtomic, op.first, target, isRaceCandidate);
+    return;
+  }
+
+  ResolutionList rl;
+  state.addressSpace.resolve(state, solver, address, rl, 0, coreSolverTimeout);
+  for (ResolutionList::iterator it = rl.begin(), ie = rl.end(); it != ie; ++it) {
+    bool res;
+    assert(solver->mustBeTrue(state, it->first->getBoundsCheckPointer(address, bytes),
+                              res) &&
+           res &&
+           "XXX array size out of bounds");
+    logMemoryAccess(state, address, bytes - 1, isWrite, isAtomic, it->first, target, isRaceCandidate);
+  }
+}
+
+void Executor::logMemoryAccess(ExecutionState &state, ref<Expr> address, unsigned length,
                                bool isWrite, bool isAtomic, const MemoryObject *mo,
                                KInstruction *instruction, bool raceCandidate) {
   if (mo->isLocal)
     return;
 
-  if (!state.logMemAccesses)
+  if (!state.logMemAccesses || isFastForwarding())
     return;
 
+  ++stats::memoryAccesses;
+
   const InstructionInfo *loc = (instruction && instruction->info) ? instruction->info : 0;
 
   ref<Lockset> lockset = isWrite? state.crtThread().getWriteLockset() : state.crtThread().getLockset();
@@ -3976,30 +4559,91 @@ void Executor::logMemoryAccess(ExecutionState &state, ref<Expr> address, unsigne
   ref<MemoryAccessEntry> newEntry = MemoryAccessEntry::create(state.crtThread().getTid(),
                                                               state.crtThread().getVectorClock(),
                                                               lockset, mo->id,
-                                                              address, bytes, loc,
+                                                              address, length, loc,
                                                               isWrite, isAtomic,
                                                               state.getSchedulingIndex());
 
   state.memoryAccesses.push_back(newEntry);
 
   if (raceCandidate) {
-    state.raceCandidates[mo->id].push_back(newEntry);
-    handleRaceDetection(state, mo, newEntry);
+    MemoryAccessShadow::entries_ty candidates;
+    getAccessCandidates(state, mo, newEntry, candidates);
+    handleRaceDetection(state, mo, newEntry, candidates);
+    if (UseDPOR)
+      handleAccessDependencies(state, newEntry, candidates);
+
+    if (ConstantExpr *CE = dyn_cast<ConstantExpr>(address))
+      state.accessShadows[mo->id].insert(CE->getZExtValue() - mo->address, length, newEntry);
+    else
+      state.raceCandidates[mo->id].push_back(newEntry);
+  }
+
+  // Ordered accesses only matter to the lockset algorithm. Sweeping when the
+  // history doubles keeps the cost constant per access.
+  if (EvictOrderedAccesses && RaceDetectionAlgorithm != LocksetAlg &&
+      state.memoryAccesses.size() >= state.nextAccessEviction) {
+    state.evictOrderedAccesses();
+    state.nextAccessEviction = std::max((size_t) 1024, 2 * state.memoryAccesses.size());
   }
+
+  // Drop a quarter of the window at once so evictions stay infrequent
+  if (RaceHistorySize && state.memoryAccesses.size() > RaceHistorySize)
+    state.evictOldestAccesses(RaceHistorySize - RaceHistorySize / 4);
 }
 
-void Executor::handleRaceDetection(ExecutionState &state, const MemoryObject *mo, const ref<MemoryAccessEntry>& ma) {
+void Executor::getAccessCandidates(ExecutionState &state, const MemoryObject *mo,
+                                   const ref<MemoryAccessEntry>& ma,
+                                   MemoryAccessShadow::entries_ty &candidates) {
+  // Concrete accesses only need to be checked against the shadow cells they
+  // cover, symbolic ones against every access in the shadow
+  ExecutionState::memory_access_shadow_t::const_iterator sit = state.accessShadows.find(mo->id);
+  if (sit != state.accessShadows.end()) {
+    if (ConstantExpr *CE = dyn_cast<ConstantExpr>(ma->getAddress()))
+      sit->second.getCandidates(CE->getZExtValue() - mo->address, ma->getLength(), candidates);
+    else
+      sit->second.getAll(candidates);
+  }
+
+  ExecutionState::memory_access_register_t::const_iterator rit = state.raceCandidates.find(mo->id);
+  if (rit != state.raceCandidates.end())
+    candidates.insert(candidates.end(), rit->second.begin(), rit->second.end());
+}
+
+void Executor::handleRaceDetection(ExecutionState &state, const MemoryObject *mo,
+                                   const ref<MemoryAccessEntry>& ma,
+                                   const MemoryAccessShadow::entries_ty &candidates) {
+  TimerStatIncrementer timer(stats::raceDetectionTime);
+  stats::raceCandidates += candidates.size();
+
+  // Filter the candidates first, so the overlap of the remaining ones can be
+  // checked with a few solver queries
+  MemoryAccessShadow::entries_ty racing;
+  for (MemoryAccessShadow::entries_ty::const_iterator it = candidates.begin(),
+       ite = candidates.end(); it != ite; ++it) {
+    if (ma->mayRace(**it))
+      racing.push_back(*it);
+  }
+  state.unorderedConflicts += racing.size();
+
+  std::vector<bool> overlapping;
+  {
+    TimerStatIncrementer overlapTimer(stats::overlapTime);
+    ma->overlap(state, *solver, racing, overlapping);
+  }
+
   std::string str;
   llvm::raw_string_ostream sos(str);
-  for (std::vector<ref<MemoryAccessEntry> >::const_iterator it = state.raceCandidates[mo->id].begin(),
-       ite = state.raceCandidates[mo->id].end(); it != ite; ++it) {
-    if (ma->isRace(state, *solver, **it)) {
-      std::string allocInfo;
+  for (unsigned i = 0; i < racing.size(); ++i) {
+    if (overlapping[i]) {
+      std::string allocInfo, allocSite;
       mo->getAllocInfo(allocInfo);
-      RaceReport rr(allocInfo, ma, *it, state.schedulingHistory);
-      if (RaceReport::emittedReports.insert(rr).second) {
-        sos << "Detected race #" << RaceReport::emittedReports.size() << ":\n"
+      mo->getAllocSite(allocSite);
+      RaceReport rr(allocInfo, allocSite, ma, racing[i], state.schedulingHistory);
+      unsigned id;
+      if (RaceReport::registerReport(rr, id)) {
+        sos << "Detected race #" << id << ":\n"
             << rr << "\n";
+        state.instsSinceNewRace = 1;
       }
     }
   }
@@ -4011,9 +4655,97 @@ void Executor::handleRaceDetection(ExecutionState &state, const MemoryObject *mo
   }
 }
 
+void Executor::handleAccessDependencies(ExecutionState &state,
+                                        const ref<MemoryAccessEntry>& ma,
+                                        const MemoryAccessShadow::entries_ty &candidates) {
+  // Only the last dependent access needs to be reversed, the earlier ones are
+  // reversed by the schedules exploring it
+  const MemoryAccessEntry *last = 0;
+  for (MemoryAccessShadow::entries_ty::const_iterator it = candidates.begin(),
+       ite = candidates.end(); it != ite; ++it) {
+    const MemoryAccessEntry &other = **it;
+    if (last && other.getScheduleIndex() <= last->getScheduleIndex())
+      continue;
+    if (ma->isOrdered(other) || !ma->isDependent(state, *solver, other))
+      continue;
+    last = &other;
+  }
+
+  if (last)
+    backtrackSchedule(state, last->getScheduleIndex(), ma->getThread());
+}
+
+void Executor::handleSyncDependencies(ExecutionState &state,
+                                      ExecutionState::sync_register_t &operations,
+                                      uint64_t id, Thread::thread_id_t tid) {
+  if (!UseDPOR)
+    return;
+
+  ExecutionState::sync_register_t::iterator it = operations.find(id);
+  if (it != operations.end() && it->second.first != tid)
+    backtrackSchedule(state, it->second.second, tid);
+  operations[id] = std::make_pair(tid, state.getSchedulingIndex());
+}
+
+void Executor::backtrackSchedule(ExecutionState &state,
+                                 std::vector<Thread::thread_id_t>::size_type index,
+                                 Thread::thread_id_t tid) {
+  if (index == 0 || index > state.schedulePoints.size())
+    return;
+
+  SchedulePoint *point = state.schedulePoints[index-1].get();
+  if (!point)
+    return;
+
+  if (point->enabled.count(tid)) {
+    SchedulePoint::parked_ty::iterator it = point->parked.find(tid);
+    if (it != point->parked.end()) {
+      resumeParkedState(state, it->second);
+      point->parked.erase(it);
+    }
+  } else {
+    // The thread may be enabled by any of the alternatives
+    for (SchedulePoint::parked_ty::iterator it = point->parked.begin(),
+         ite = point->parked.end(); it != ite; ++it)
+      resumeParkedState(state, it->second);
+    point->parked.clear();
+  }
+}
+
+void Executor::resumeParkedState(ExecutionState &state, ExecutionState *parked) {
+  // Hang the parked state from the node of the state that resumes it
+  state.ptreeNode->data = 0;
+  std::pair<PTree::Node*,PTree::Node*> res =
+      processTree->split(state.ptreeNode, parked, &state,
+                         getForkTag(state, KLEE_FORK_SCHEDULE));
+  parked->ptreeNode = res.first;
+  state.ptreeNode = res.second;
+  addedStates.insert(parked);
+}
+
+void Executor::discardSchedulePoints(ExecutionState &state) {
+  // Points are shared with the states forked after them, so once a point is
+  // still referenced by another live state, so are all the previous ones
+  for (std::vector<ref<SchedulePoint> >::size_type i = state.schedulePoints.size();
+       i > 0; --i) {
+    SchedulePoint *point = state.schedulePoints[i-1].get();
+    if (!point)
+      continue;
+    if (point->liveReferences() > 1)
+      break;
+
+    for (SchedulePoint::parked_ty::iterator it = point->parked.begin(),
+         ite = point->parked.end(); it != ite; ++it) {
+      delete it->second;
+      ++stats::prunedSchedules;
+    }
+    point->parked.clear();
+  }
+}
+
 ForkTag Executor::getForkTag(const ExecutionState &state, ForkType reason) {
   ForkTag tag(reason);
-  if (state.crtThreadIt != state.threads.end()) {
+  if (state.threads.count(state.crtThreadId)) {
     tag.function = state.stack().back().kf->function;
     tag.instruction = state.prevPC()->info;
   }
@@ -177,6 +177,23 @@ private:
   /// step.
   bool haltExecution;  
 
+  /// Set once the states have been split among worker processes.
+  bool workersForked;
+
+  /// Worker processes forked by this process. \see forkWorkers()
+  std::vector<int> workerPids;
+
+  /// PCT: copy of the initial state the following trials start from, null
+  /// once every trial has started. \see startPCTTrial()
+  ExecutionState *pctInitialState;
+
+  /// PCT: number of trials started
+  unsigned pctTrials;
+
+  /// Number of states over which states are exported again, so they are
+  /// only ranked when their number grows. \see exportSchedulePrefixes()
+  size_t partitionThreshold;
+
   /// Whether implied-value concretization is enabled. Currently
   /// false, it is buggy (it needs to validate its writes).
   bool ivcEnabled;
@@ -194,6 +211,28 @@ private:
 
   void run(ExecutionState &initialState);
 
+  /// Fork ParallelWorkers-1 worker processes, each of them keeping a
+  /// disjoint subset of the current states. The states sharing schedule
+  /// points are kept by the same worker.
+  void forkWorkers();
+
+  /// Export the states beyond the \a keep deepest ones as schedule prefixes
+  /// for other processes, and drop them from this exploration. The states
+  /// whose path a replay would not reproduce are kept.
+  void exportSchedulePrefixes(unsigned keep);
+
+  /// Whether replaying the inputs and the schedule of \a state reaches the
+  /// same state: its inputs are fixed by the path constraints and it only
+  /// woke the first waiters of the waiting lists.
+  bool canExportSchedulePrefix(const ExecutionState &state);
+
+  /// PCT: draw the priority change points of a new trial
+  void initPCT(ExecutionState &state);
+
+  /// PCT: start the next trial from a fresh copy of the initial state, or
+  /// drop the copy once every trial has started
+  void startPCTTrial();
+
   // Given a concrete object in our [klee's] address space, add it to 
   // objects checked code can reference.
   MemoryObject *addExternalObject(ExecutionState &state, void *addr, 
@@ -417,12 +456,57 @@ private:
 
   KFunction* resolveFunction(ref<Expr> address);
 
-  void logMemoryAccess(ExecutionState &state, ref<Expr> address, unsigned bytes,
+  /// Log an access of \a bytes at \a address to every object it may point to
+  void executeMemoryAccess(ExecutionState &state, KInstruction *target,
+                           ref<Expr> address, unsigned bytes,
+                           bool isWrite, bool isAtomic, bool isRaceCandidate);
+
+  /// Log an access to the bytes [address, address+length] of \a mo. The
+  /// length is inclusive, one less than the size of the access.
+  void logMemoryAccess(ExecutionState &state, ref<Expr> address, unsigned length,
                        bool isWrite, bool isAtomic, const MemoryObject *mo,
                        KInstruction *instruction, bool raceCandidate);
 
+  void getAccessCandidates(ExecutionState &state, const MemoryObject *mo,
+                           const ref<MemoryAccessEntry>& ma,
+                           MemoryAccessShadow::entries_ty &candidates);
+
   void handleRaceDetection(ExecutionState &state, const MemoryObject *mo,
-                           const ref<MemoryAccessEntry>& ma);
+                           const ref<MemoryAccessEntry>& ma,
+                           const MemoryAccessShadow::entries_ty &candidates);
+
+  /// DPOR: explore the parked schedules that reorder the memory access with
+  /// the last dependent access of another thread
+  void handleAccessDependencies(ExecutionState &state,
+                                const ref<MemoryAccessEntry>& ma,
+                                const MemoryAccessShadow::entries_ty &candidates);
+
+  /// DPOR: explore the parked schedules that reorder the synchronization
+  /// operation of thread tid on object id with the last one of another thread
+  void handleSyncDependencies(ExecutionState &state,
+                              ExecutionState::sync_register_t &operations,
+                              uint64_t id, Thread::thread_id_t tid);
+
+  /// DPOR: explore the parked schedule running thread tid at the scheduling
+  /// point of the given index, or every parked schedule if tid was not enabled
+  void backtrackSchedule(ExecutionState &state,
+                         std::vector<Thread::thread_id_t>::size_type index,
+                         Thread::thread_id_t tid);
+
+  /// DPOR: add a parked state to the process tree and the searcher
+  void resumeParkedState(ExecutionState &state, ExecutionState *parked);
+
+  /// Sleep sets: record the footprint of the transition of thread tid that
+  /// just finished and wake up the threads dependent with it
+  void updateSleepSet(ExecutionState &state, Thread::thread_id_t tid);
+
+  /// Sleep sets: the current transition forked, so its footprint is not
+  /// valid for the sibling schedules
+  void markTransitionForked(ExecutionState &state);
+
+  /// DPOR: discard the parked schedules that are no longer reachable once
+  /// the state is removed
+  void discardSchedulePoints(ExecutionState &state);
 
   ForkTag getForkTag(const ExecutionState &state, ForkType reason);
 
@@ -471,6 +555,8 @@ public:
                                  char **argv,
                                  char **envp);
 
+  virtual void waitWorkers();
+
   /*** Runtime options ***/
   
   virtual void setHaltExecution(bool value) {
@@ -514,6 +600,15 @@ public:
   // Schedule next thread. If yield is true the current thread cannot be rescheduled
   bool schedule(ExecutionState &state, bool yield, bool terminateThread);
 
+  // PCT: schedule the enabled thread with the highest priority
+  void schedulePCT(ExecutionState &state, Thread::thread_id_t oldTid, bool yield);
+
+  // Number of scheduling steps of replayOut to replay
+  unsigned getReplayScheduleSteps() const;
+
+  // Whether the replayed scheduling steps are being fast forwarded
+  bool isFastForwarding() const;
+
   // Enable and schedule a thread in the waiting list
   void executeThreadNotifyOne(ExecutionState &state, Thread::wlist_id_t wlist);
 
@@ -1,43 +1,130 @@
 #include "Lockset.h"
 
+#include <algorithm>
+#include <iterator>
+
+#include <ciso646>
+#ifdef _LIBCPP_VERSION
+#include <unordered_set>
+#define unordered_set std::unordered_set
+#else
+#include <tr1/unordered_set>
+#define unordered_set std::tr1::unordered_set
+#endif
+
 using namespace klee;
 
-ref<Lockset> Lockset::alloc(const std::set<uint64_t> locks) {
-  ref<Lockset> r(new Lockset(locks));
-  return r;
+namespace {
+  struct LocksetHash {
+    unsigned operator()(const Lockset *ls) const {
+      return ls->hash();
+    }
+  };
+
+  struct LocksetEq {
+    bool operator()(const Lockset *a, const Lockset *b) const {
+      return a->compare(*b) == 0;
+    }
+  };
+
+  typedef unordered_set<Lockset*, LocksetHash, LocksetEq> lockset_table_t;
+
+  // Table of live locksets, used to share identical ones. Never freed, as
+  // locksets may outlive it during static destruction.
+  lockset_table_t &getLocksetTable() {
+    static lockset_table_t *table = new lockset_table_t();
+    return *table;
+  }
+}
+
+Lockset::Lockset(const locks_ty &_locks)
+    : locks(_locks), refCount(0) {
+  hashValue = 0;
+  for (locks_iterator_t it = locks.begin(); it != locks.end(); ++it)
+    hashValue = (hashValue * 31) ^ (unsigned) (*it ^ (*it >> 32));
+}
+
+Lockset::~Lockset() {
+  lockset_table_t &table = getLocksetTable();
+  lockset_table_t::iterator it = table.find(this);
+  if (it != table.end() && *it == this)
+    table.erase(it);
+}
+
+ref<Lockset> Lockset::alloc(const locks_ty &locks) {
+  lockset_table_t &table = getLocksetTable();
+  Lockset key(locks);
+  lockset_table_t::iterator it = table.find(&key);
+  if (it != table.end())
+    return ref<Lockset>(*it);
+
+  Lockset *ls = new Lockset(locks);
+  table.insert(ls);
+  return ref<Lockset>(ls);
 }
 
 int Lockset::compare(const Lockset &other) const {
+  if (this == &other)
+    return 0;
   if (locks.size() < other.locks.size())
     return -1;
-  if (locks == other.locks)
-    return 0;
-  return 1;
+  if (locks.size() > other.locks.size())
+    return 1;
+  for (locks_iterator_t itA = locks.begin(), itB = other.locks.begin();
+       itA != locks.end(); ++itA, ++itB) {
+    if (*itA < *itB)
+      return -1;
+    if (*itA > *itB)
+      return 1;
+  }
+  return 0;
 }
 
 ref<Lockset> Lockset::erase(uint64_t val) const {
-  std::set<uint64_t> upd(locks);
-  upd.erase(val);
+  locks_iterator_t pos = std::lower_bound(locks.begin(), locks.end(), val);
+  if (pos == locks.end() || *pos != val)
+    return ref<Lockset>(const_cast<Lockset*>(this));
+
+  locks_ty upd(locks.begin(), pos);
+  upd.append(pos+1, locks.end());
   return Lockset::alloc(upd);
 }
 
 ref<Lockset> Lockset::insert(uint64_t val) const {
-  std::set<uint64_t> upd(locks);
-  upd.insert(val);
+  locks_iterator_t pos = std::lower_bound(locks.begin(), locks.end(), val);
+  if (pos != locks.end() && *pos == val)
+    return ref<Lockset>(const_cast<Lockset*>(this));
+
+  locks_ty upd(locks.begin(), pos);
+  upd.push_back(val);
+  upd.append(pos, locks.end());
   return Lockset::alloc(upd);
 }
 
 ref<Lockset> Lockset::intersect(const Lockset &other) const {
-  std::set<uint64_t> inter;
-  for (locks_iterator_t it = locks.begin();
-       it != locks.end();++it) {
-    if (other.locks.find(*it) != other.locks.end())
-      inter.insert(*it);
-  }
-
+  locks_ty inter;
+  std::set_intersection(locks.begin(), locks.end(),
+                        other.locks.begin(), other.locks.end(),
+                        std::back_inserter(inter));
   return Lockset::alloc(inter);
 }
 
+bool Lockset::disjoint(const Lockset &other) const {
+  if (this == &other)
+    return locks.empty();
+
+  locks_iterator_t itA = locks.begin(), itB = other.locks.begin();
+  while (itA != locks.end() && itB != other.locks.end()) {
+    if (*itA < *itB)
+      ++itA;
+    else if (*itB < *itA)
+      ++itB;
+    else
+      return false;
+  }
+  return true;
+}
+
 void Lockset::print(llvm::raw_ostream &os) const {
   os << "(";
   for (locks_iterator_t it = locks.begin();
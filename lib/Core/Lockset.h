@@ -5,32 +5,48 @@
 
 #include "klee/util/Ref.h"
 
+#include "llvm/ADT/SmallVector.h"
 #include "llvm/Support/raw_ostream.h"
 
 #include <set>
 
 namespace klee {
 
+/// Immutable, hash-consed set of held locks.
+///
+/// Locks are kept sorted in a small inline array, as threads rarely hold more
+/// than a few of them. Identical locksets share the same object, so equality
+/// is pointer equality.
 class Lockset {
+public:
+  typedef llvm::SmallVector<uint64_t, 4> locks_ty;
+
 private:
-  typedef std::set<uint64_t>::const_iterator
+  typedef locks_ty::const_iterator
   locks_iterator_t;
-  const std::set<uint64_t> locks;
+  const locks_ty locks;
+
+  unsigned hashValue;
 
-  Lockset(const std::set<uint64_t> _locks)
-      : locks(_locks), refCount(0) {}
+  Lockset(const locks_ty &_locks);
 
 public:
   unsigned refCount;
 
+  ~Lockset();
+
   static ref<Lockset> create() {
-    std::set<uint64_t> empty;
+    locks_ty empty;
     return Lockset::alloc(empty);
   };
-  static ref<Lockset> create(const std::set<uint64_t> locks) {
-    return Lockset::alloc(locks);
+  static ref<Lockset> create(const std::set<uint64_t> &locks) {
+    locks_ty sorted(locks.begin(), locks.end());
+    return Lockset::alloc(sorted);
   };
-  static ref<Lockset> alloc(const std::set<uint64_t> locks);
+  /// \a locks must be sorted and without duplicates
+  static ref<Lockset> alloc(const locks_ty &locks);
+
+  unsigned hash() const { return hashValue; }
 
   int compare(const Lockset &other) const;
 
@@ -41,9 +57,7 @@ public:
 
   bool empty() const { return locks.empty(); };
 
-  bool disjoint(const Lockset &other) const {
-    return intersect(other)->empty();
-  };
+  bool disjoint(const Lockset &other) const;
 
   void print(llvm::raw_ostream &os) const;
 };
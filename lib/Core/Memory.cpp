@@ -78,6 +78,12 @@ void MemoryObject::getAllocInfo(std::string &result) const {
   llvm::raw_string_ostream info(result);
 
   info << "MO" << id << "[" << size << "]";
+  info.flush();
+  getAllocSite(result);
+}
+
+void MemoryObject::getAllocSite(std::string &result) const {
+  llvm::raw_string_ostream info(result);
 
   if (allocSite) {
     info << " allocated at ";
@@ -107,6 +107,10 @@ public:
   /// Get an identifying string for this allocation.
   void getAllocInfo(std::string &result) const;
 
+  /// Get a string describing where the object was allocated, the same for
+  /// every object allocated at that site.
+  void getAllocSite(std::string &result) const;
+
   void setName(std::string name) const {
     this->name = name;
   }
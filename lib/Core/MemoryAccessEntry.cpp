@@ -1,8 +1,12 @@
 #include "MemoryAccessEntry.h"
 
+#include "CoreStats.h"
 #include "RaceDetection.h"
 #include "TimingSolver.h"
 
+#include "klee/util/Assignment.h"
+#include "klee/util/ExprUtil.h"
+
 #include "llvm/Support/CommandLine.h"
 
 using namespace llvm;
@@ -40,13 +44,135 @@ ref<MemoryAccessEntry> MemoryAccessEntry::alloc(Thread::thread_id_t _thread, con
 }
 
 bool MemoryAccessEntry::overlap(const ExecutionState &state, TimingSolver &solver, const MemoryAccessEntry &other) const {
-  // Check if true: address+length >= other.address AND address <= other.address+other.length
-  ref<Expr> overlapExpr = AndExpr::create(UgeExpr::create(end, other.address), UleExpr::create(address, other.end));
+  if (mo != other.mo)
+    return false;
+
+  // Constant addresses, the common case, do not need the solver
+  ConstantExpr *start = dyn_cast<ConstantExpr>(address);
+  ConstantExpr *otherStart = dyn_cast<ConstantExpr>(other.address);
+  if (start && otherStart)
+    return overlapConstant(start->getZExtValue(), otherStart->getZExtValue(), other);
+
   bool result = false;
-  return (mo == other.mo) && (solver.mustBeTrue(state, overlapExpr, result) && result);
+  ++stats::overlapQueries;
+  return solver.mustBeTrue(state, overlapCondition(other), result) && result;
+}
+
+ref<Expr> MemoryAccessEntry::overlapCondition(const MemoryAccessEntry &other) const {
+  // Check if true: address+length >= other.address AND address <= other.address+other.length
+  return AndExpr::create(UgeExpr::create(end, other.address), UleExpr::create(address, other.end));
+}
+
+void MemoryAccessEntry::overlap(const ExecutionState &state, TimingSolver &solver,
+                                const std::vector<ref<MemoryAccessEntry> > &others,
+                                std::vector<bool> &result) const {
+  result.assign(others.size(), false);
+
+  ConstantExpr *start = dyn_cast<ConstantExpr>(address);
+  std::vector<ref<Expr> > conditions(others.size());
+  std::vector<unsigned> pending;
+  for (unsigned i = 0; i < others.size(); ++i) {
+    const MemoryAccessEntry &other = *others[i];
+    if (mo != other.mo)
+      continue;
+
+    ConstantExpr *otherStart = dyn_cast<ConstantExpr>(other.address);
+    if (start && otherStart) {
+      result[i] = overlapConstant(start->getZExtValue(), otherStart->getZExtValue(), other);
+      continue;
+    }
+
+    conditions[i] = overlapCondition(other);
+    if (ConstantExpr *CE = dyn_cast<ConstantExpr>(conditions[i]))
+      result[i] = CE->isTrue();
+    else
+      pending.push_back(i);
+  }
+
+  while (pending.size() > 1) {
+    ref<Expr> all = conditions[pending[0]];
+    for (unsigned i = 1; i < pending.size(); ++i)
+      all = AndExpr::create(all, conditions[pending[i]]);
+
+    // A single query either proves every condition, or gives a model
+    // falsifying some of them
+    std::vector<const Array*> objects;
+    findSymbolicObjects(all, objects);
+    std::vector< std::vector<unsigned char> > values;
+    bool hasSolution = false;
+    ++stats::overlapQueries;
+    if (!solver.getCounterexample(state, all, objects, values, hasSolution))
+      return;
+    if (!hasSolution) {
+      for (unsigned i = 0; i < pending.size(); ++i)
+        result[pending[i]] = true;
+      return;
+    }
+
+    Assignment model(objects, values, true);
+    std::vector<unsigned> remaining;
+    for (unsigned i = 0; i < pending.size(); ++i) {
+      ref<Expr> value = model.evaluate(conditions[pending[i]]);
+      ConstantExpr *CE = dyn_cast<ConstantExpr>(value);
+      if (!CE || !CE->isFalse())
+        remaining.push_back(pending[i]);
+    }
+
+    // A round dropping a single condition costs as much as checking it
+    // alone, so check the remaining ones one by one
+    bool progress = remaining.size() + 1 < pending.size();
+    pending.swap(remaining);
+    if (!progress)
+      break;
+  }
+
+  for (unsigned i = 0; i < pending.size(); ++i) {
+    bool valid = false;
+    ++stats::overlapQueries;
+    result[pending[i]] = solver.mustBeTrue(state, conditions[pending[i]], valid) && valid;
+  }
+}
+
+bool MemoryAccessEntry::overlapConstant(uint64_t start, uint64_t otherStart,
+                                        const MemoryAccessEntry &other) const {
+  return start + length >= otherStart && start <= otherStart + other.length;
+}
+
+bool MemoryAccessEntry::isOrdered(const MemoryAccessEntry &other) const {
+  return vc->happensBefore(*other.vc, thread) ||
+         other.vc->happensBefore(*vc, other.thread);
+}
+
+bool MemoryAccessEntry::isDependent(const ExecutionState &state, TimingSolver &solver, const MemoryAccessEntry &other) const {
+  if (thread == other.thread)
+    return false;
+
+  if (!isWrite && !other.isWrite)
+    return false;
+
+  return overlap(state, solver, other);
+}
+
+bool MemoryAccessEntry::mayConflict(const MemoryAccessEntry &other) const {
+  if (mo != other.mo)
+    return false;
+
+  if (!isWrite && !other.isWrite)
+    return false;
+
+  ConstantExpr *start = dyn_cast<ConstantExpr>(address);
+  ConstantExpr *otherStart = dyn_cast<ConstantExpr>(other.address);
+  if (!start || !otherStart)
+    return true;
+
+  return overlapConstant(start->getZExtValue(), otherStart->getZExtValue(), other);
 }
 
 bool MemoryAccessEntry::isRace(const ExecutionState &state, TimingSolver &solver, const MemoryAccessEntry &other) const {
+  return mayRace(other) && overlap(state, solver, other);
+}
+
+bool MemoryAccessEntry::mayRace(const MemoryAccessEntry &other) const {
   if (thread == other.thread)
     return false;
 
@@ -75,23 +201,37 @@ bool MemoryAccessEntry::isRace(const ExecutionState &state, TimingSolver &solver
       return false;
     case HappensBeforeAlg:
     case WeakHappensBeforeAlg:
-      if (vc->isOrdered(*other.vc))
+      if (isOrdered(other)) {
+        ++stats::raceOrderedCandidates;
         return false;
+      }
       break;
     case LocksetAlg:
-      if (!lockset->disjoint(*other.lockset))
+      if (!lockset->disjoint(*other.lockset)) {
+        ++stats::raceLockedCandidates;
         return false;
+      }
       break;
     case HybridAlg:
-      if (vc->isOrdered(*other.vc))
+      if (isOrdered(other)) {
+        ++stats::raceOrderedCandidates;
         return false;
-      if (!lockset->disjoint(*other.lockset))
+      }
+      if (!lockset->disjoint(*other.lockset)) {
+        ++stats::raceLockedCandidates;
         return false;
+      }
       break;
     default: klee_error("invalid -race-detection");
   }
 
-  return overlap(state, solver, other);
+  return true;
+}
+
+bool MemoryAccessEntry::supersedes(const MemoryAccessEntry &other) const {
+  return thread == other.thread && mo == other.mo &&
+         isWrite == other.isWrite && isAtomic == other.isAtomic &&
+         lockset->compare(*other.lockset) == 0;
 }
 
 int MemoryAccessEntry::compare(const MemoryAccessEntry &other) const {
@@ -141,6 +281,20 @@ int MemoryAccessEntry::compare(const MemoryAccessEntry &other) const {
   return 0;
 }
 
+uint64_t MemoryAccessEntry::hash() const {
+  // FNV-1a
+  uint64_t h = 14695981039346656037ULL;
+  if (location) {
+    for (std::string::const_iterator it = location->file.begin(),
+         ite = location->file.end(); it != ite; ++it)
+      h = (h ^ (unsigned char) *it) * 1099511628211ULL;
+    h = (h ^ location->line) * 1099511628211ULL;
+  }
+  h = (h ^ length) * 1099511628211ULL;
+  h = (h ^ ((isWrite ? 1 : 0) | (isAtomic ? 2 : 0))) * 1099511628211ULL;
+  return h;
+}
+
 void MemoryAccessEntry::print(llvm::raw_ostream &os) const {
   if (isAtomic)
     os << "atomic ";
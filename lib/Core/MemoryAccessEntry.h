@@ -33,6 +33,13 @@ private:
   bool isAtomic;
   std::vector<Thread::thread_id_t>::size_type scheduleIndex;
 
+  /// Interval check of overlap() for accesses starting at constant addresses
+  bool overlapConstant(uint64_t start, uint64_t otherStart,
+                       const MemoryAccessEntry &other) const;
+
+  /// Condition checked by overlap() for accesses at symbolic addresses
+  ref<Expr> overlapCondition(const MemoryAccessEntry &other) const;
+
   MemoryAccessEntry(Thread::thread_id_t _thread, const ref<VectorClock> _vc,
                     const ref<Lockset> _lockset, MemoryObject::id_t _mo,
                     const ref<Expr> _address, unsigned _length, const ref<Expr> _end,
@@ -62,8 +69,52 @@ public:
 
   int compare(const MemoryAccessEntry &other) const;
 
+  /// Hash of the location and kind of the access, stable across processes
+  uint64_t hash() const;
+
+  Thread::thread_id_t getThread() const { return thread; }
+
+  MemoryObject::id_t getMemoryObjectId() const { return mo; }
+
+  std::vector<Thread::thread_id_t>::size_type getScheduleIndex() const { return scheduleIndex; }
+
+  ref<Expr> getAddress() const { return address; }
+
+  unsigned getLength() const { return length; }
+
+  /// Returns true if this access makes \a other redundant for race detection:
+  /// both were done by the same thread with the same kind and lockset, so
+  /// \a other happens before this access.
+  bool supersedes(const MemoryAccessEntry &other) const;
+
   bool overlap(const ExecutionState &state, TimingSolver &solver, const MemoryAccessEntry &other) const;
 
+  /// Check if the accesses are ordered by happens-before
+  bool isOrdered(const MemoryAccessEntry &other) const;
+
+  /// Check if the access happens before a thread with clock \a clock
+  bool happensBefore(const VectorClock &clock) const { return vc->happensBefore(clock, thread); }
+
+  /// Check if the accesses are done by different threads to overlapping
+  /// bytes and at least one of them is a write
+  bool isDependent(const ExecutionState &state, TimingSolver &solver, const MemoryAccessEntry &other) const;
+
+  /// Check without the solver if the accesses may touch the same bytes and at
+  /// least one of them is a write. Only accesses to constant addresses can
+  /// be proved disjoint.
+  bool mayConflict(const MemoryAccessEntry &other) const;
+
+  /// Check which of \a others must overlap this access, setting the
+  /// matching element of \a result. The conditions of the accesses at
+  /// symbolic addresses are checked together: every counterexample to their
+  /// conjunction rules out all the conditions it falsifies.
+  void overlap(const ExecutionState &state, TimingSolver &solver,
+               const std::vector<ref<MemoryAccessEntry> > &others,
+               std::vector<bool> &result) const;
+
+  /// Check every race condition but the overlap of the accesses
+  bool mayRace(const MemoryAccessEntry &other) const;
+
   bool isRace(const ExecutionState &state, TimingSolver &solver, const MemoryAccessEntry &other) const;
 
   void print(llvm::raw_ostream &os) const;
@@ -0,0 +1,128 @@
+#include "MemoryAccessShadow.h"
+
+#include <limits>
+
+using namespace klee;
+
+static bool sameEntries(const MemoryAccessShadow::entries_ty &a,
+                        const MemoryAccessShadow::entries_ty &b) {
+  if (a.size() != b.size())
+    return false;
+  for (unsigned i = 0; i < a.size(); ++i) {
+    if (a[i].get() != b[i].get())
+      return false;
+  }
+  return true;
+}
+
+void MemoryAccessShadow::split(uint64_t offset) {
+  segments_ty::iterator it = segments.upper_bound(offset);
+  if (it == segments.begin())
+    return;
+  --it;
+  if (it->first == offset || it->second.last < offset)
+    return;
+
+  Segment upper(it->second.last);
+  upper.entries = it->second.entries;
+  it->second.last = offset - 1;
+  segments.insert(++it, std::make_pair(offset, upper));
+}
+
+void MemoryAccessShadow::coalesce(uint64_t first, uint64_t last) {
+  segments_ty::iterator it = segments.upper_bound(first);
+  if (it != segments.begin())
+    --it;
+  while (it != segments.end() && it->first <= last) {
+    segments_ty::iterator next = it;
+    ++next;
+    if (next != segments.end() && it->second.last + 1 == next->first &&
+        sameEntries(it->second.entries, next->second.entries)) {
+      it->second.last = next->second.last;
+      segments.erase(next);
+    } else {
+      it = next;
+    }
+  }
+}
+
+void MemoryAccessShadow::insert(uint64_t offset, unsigned length,
+                                const ref<MemoryAccessEntry> &entry) {
+  uint64_t last = offset + length;
+  split(offset);
+  split(last + 1);
+
+  uint64_t next = offset;
+  segments_ty::iterator it = segments.lower_bound(offset);
+  while (next <= last) {
+    if (it == segments.end() || it->first > next) {
+      // Fill the gap up to the next segment
+      uint64_t gapLast = (it == segments.end() || it->first > last) ?
+                         last : it->first - 1;
+      it = segments.insert(it, std::make_pair(next, Segment(gapLast)));
+    }
+
+    entries_ty &cell = it->second.entries;
+    for (entries_ty::iterator eit = cell.begin(); eit != cell.end();) {
+      if (entry->supersedes(**eit))
+        eit = cell.erase(eit);
+      else
+        ++eit;
+    }
+    cell.push_back(entry);
+
+    next = it->second.last + 1;
+    ++it;
+  }
+
+  coalesce(offset, last + 1);
+}
+
+void MemoryAccessShadow::getCandidates(uint64_t offset, unsigned length,
+                                       entries_ty &result) const {
+  segments_ty::const_iterator it = segments.upper_bound(offset);
+  if (it != segments.begin()) {
+    --it;
+    if (it->second.last < offset)
+      ++it;
+  }
+
+  std::set<const MemoryAccessEntry*> seen;
+  for (segments_ty::const_iterator ite = segments.end();
+       it != ite && it->first <= offset + length; ++it) {
+    for (entries_ty::const_iterator eit = it->second.entries.begin(),
+         eite = it->second.entries.end(); eit != eite; ++eit) {
+      if (seen.insert(eit->get()).second)
+        result.push_back(*eit);
+    }
+  }
+}
+
+void MemoryAccessShadow::getAll(entries_ty &result) const {
+  std::set<const MemoryAccessEntry*> seen;
+  for (segments_ty::const_iterator it = segments.begin(), ite = segments.end();
+       it != ite; ++it) {
+    for (entries_ty::const_iterator eit = it->second.entries.begin(),
+         eite = it->second.entries.end(); eit != eite; ++eit) {
+      if (seen.insert(eit->get()).second)
+        result.push_back(*eit);
+    }
+  }
+}
+
+void MemoryAccessShadow::remove(const std::set<const MemoryAccessEntry*> &evicted) {
+  for (segments_ty::iterator it = segments.begin(); it != segments.end();) {
+    entries_ty &cell = it->second.entries;
+    for (entries_ty::iterator eit = cell.begin(); eit != cell.end();) {
+      if (evicted.count(eit->get()))
+        eit = cell.erase(eit);
+      else
+        ++eit;
+    }
+    if (cell.empty())
+      segments.erase(it++);
+    else
+      ++it;
+  }
+  coalesce(0, std::numeric_limits<uint64_t>::max());
+}
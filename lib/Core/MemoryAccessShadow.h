@@ -0,0 +1,68 @@
+#ifndef MEMORYACCESSSHADOW_H
+#define MEMORYACCESSSHADOW_H
+
+#include "MemoryAccessEntry.h"
+
+#include "klee/util/Ref.h"
+
+#include <map>
+#include <set>
+#include <vector>
+
+namespace klee {
+
+/// Shadow index of the accesses to concrete addresses of a memory object.
+///
+/// Every byte offset only keeps the last access of each (thread, access kind,
+/// lockset) combination: an older access with the same combination happens
+/// before the newer one, so any later access racing with the older also races
+/// with the newer. The candidates for a concrete access are therefore bounded
+/// by the number of threads instead of by the length of the path.
+///
+/// Bytes are grouped in disjoint segments sharing the same accesses, so the
+/// cost of a lookup depends on the number of distinct ranges accessed and not
+/// on the number of bytes.
+class MemoryAccessShadow {
+public:
+  typedef std::vector<ref<MemoryAccessEntry> > entries_ty;
+
+private:
+  struct Segment {
+    /// Last byte offset of the segment, inclusive
+    uint64_t last;
+    entries_ty entries;
+
+    Segment(uint64_t _last) : last(_last) {}
+  };
+
+  /// Segments indexed by their first byte offset
+  typedef std::map<uint64_t, Segment> segments_ty;
+  segments_ty segments;
+
+  /// Make \a offset the first byte of a segment if a segment covers it
+  void split(uint64_t offset);
+
+  /// Merge the adjacent segments with the same accesses between the segments
+  /// covering \a first and \a last
+  void coalesce(uint64_t first, uint64_t last);
+
+public:
+  bool empty() const { return segments.empty(); }
+
+  /// Register an access covering the bytes [offset, offset+length], dropping
+  /// the previous accesses it supersedes.
+  void insert(uint64_t offset, unsigned length, const ref<MemoryAccessEntry> &entry);
+
+  /// Collect the registered accesses covering any of the bytes
+  /// [offset, offset+length]. Each access is reported once.
+  void getCandidates(uint64_t offset, unsigned length, entries_ty &result) const;
+
+  /// Collect every registered access. Each access is reported once.
+  void getAll(entries_ty &result) const;
+
+  /// Drop the accesses in \a evicted
+  void remove(const std::set<const MemoryAccessEntry*> &evicted);
+};
+}
+
+#endif // MEMORYACCESSSHADOW_H
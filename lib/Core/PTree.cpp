@@ -73,6 +73,13 @@ void PTree::dump(llvm::raw_ostream &os) {
     os << "tid "<< n->tid << "\n";
     os << n->forkTag << "\n";
     os << "sched " << n->schedulingIndex  << "\n";
+    if (!n->sleeping.empty()) {
+      os << "sleep";
+      for (std::set<Thread::thread_id_t>::iterator it = n->sleeping.begin(),
+           ite = n->sleeping.end(); it != ite; ++it)
+        os << " " << *it;
+      os << "\n";
+    }
 
     if (n->condition.isNull()) {
       os << "\"";
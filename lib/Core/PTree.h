@@ -54,6 +54,10 @@ namespace klee {
 
     // Thread enabled at end of PNode
     std::set<Thread::thread_id_t> enabled;
+
+    // Thread asleep at end of PNode, not forked as their schedule is
+    // equivalent to an explored one
+    std::set<Thread::thread_id_t> sleeping;
   private:
     PTreeNode(PTreeNode *_parent, ExecutionState *_data);
     ~PTreeNode();
@@ -1,42 +1,324 @@
 #include "RaceReport.h"
 
+#include "Common.h"
+
+#include "llvm/Support/CommandLine.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ipc.h>
+#include <sys/mman.h>
+#include <sys/shm.h>
+#include <sys/stat.h>
+
+#include <vector>
+
 using namespace klee;
+using namespace llvm;
 
-std::set<RaceReport> RaceReport::emittedReports;
+std::set<uint64_t> RaceReport::emittedReports;
 
-bool RaceReport::operator<(const RaceReport &rr) const {
-  if (current < rr.current)
-    return true;
-  else if (rr.current < rr.current)
-    return false;
-  else if (previous < rr.previous)
+namespace {
+  cl::opt<std::string>
+  RaceDatabase("race-db",
+               cl::desc("File keeping the races reported by every run using it. Races already in the file are not reported again (default=none)"),
+               cl::init(""));
+
+  const char raceDatabaseMagic[8] = { 'K', 'R', 'A', 'C', 'E', 'D', 'B', '1' };
+
+  /// Open addressing table of report hashes in a file mapped by every
+  /// process using it. The file is locked while it is read or updated, and
+  /// doubles its capacity once three quarters of the slots are taken.
+  class PersistentReports {
+  private:
+    struct Header {
+      char magic[8];
+      uint64_t capacity;
+      uint64_t count;
+    };
+
+    int fd;
+    size_t mappedSize;
+    Header *header;
+
+    uint64_t *slots() const { return (uint64_t*) (header + 1); }
+
+    static size_t fileSize(uint64_t capacity) {
+      return sizeof(Header) + capacity * sizeof(uint64_t);
+    }
+
+    bool lock(short type) {
+      struct flock fl;
+      memset(&fl, 0, sizeof(fl));
+      fl.l_type = type;
+      fl.l_whence = SEEK_SET;
+      while (fcntl(fd, F_SETLKW, &fl) < 0) {
+        if (errno != EINTR)
+          return false;
+      }
+      return true;
+    }
+
+    /// Map the whole file, which other processes may have grown
+    bool remap() {
+      struct stat st;
+      if (fstat(fd, &st) < 0)
+        return false;
+      if (header && (size_t) st.st_size == mappedSize)
+        return true;
+      if (header)
+        munmap(header, mappedSize);
+      header = 0;
+      if ((size_t) st.st_size < sizeof(Header))
+        return false;
+      void *ptr = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      if (ptr == MAP_FAILED)
+        return false;
+      header = (Header*) ptr;
+      mappedSize = st.st_size;
+      return true;
+    }
+
+    bool valid() const {
+      return !memcmp(header->magic, raceDatabaseMagic, sizeof(raceDatabaseMagic)) &&
+             header->capacity && mappedSize == fileSize(header->capacity);
+    }
+
+    /// Returns true if h was not in the table
+    static bool insert(uint64_t *table, uint64_t capacity, uint64_t h) {
+      for (uint64_t i = 0, slot = h % capacity; i < capacity;
+           ++i, slot = (slot + 1) % capacity) {
+        if (table[slot] == h)
+          return false;
+        if (table[slot] == 0) {
+          table[slot] = h;
+          return true;
+        }
+      }
+      assert(0 && "race database full");
+      return false;
+    }
+
+    bool grow() {
+      std::vector<uint64_t> hashes;
+      for (uint64_t i = 0; i < header->capacity; ++i) {
+        if (slots()[i])
+          hashes.push_back(slots()[i]);
+      }
+      uint64_t capacity = 2 * header->capacity;
+      if (ftruncate(fd, fileSize(capacity)) < 0)
+        return false;
+      if (!remap()) {
+        // Leave the file as it was
+        if (ftruncate(fd, fileSize(capacity / 2)) == 0)
+          remap();
+        return false;
+      }
+      header->capacity = capacity;
+      memset(slots(), 0, capacity * sizeof(uint64_t));
+      for (unsigned i = 0; i < hashes.size(); ++i)
+        insert(slots(), capacity, hashes[i]);
+      return true;
+    }
+
+  public:
+    PersistentReports() : fd(-1), mappedSize(0), header(0) {}
+
+    bool open(const std::string &path) {
+      fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+      if (fd < 0 || !lock(F_WRLCK))
+        return false;
+
+      struct stat st;
+      bool ok = fstat(fd, &st) == 0;
+      if (ok && st.st_size == 0) {
+        Header empty;
+        memcpy(empty.magic, raceDatabaseMagic, sizeof(raceDatabaseMagic));
+        empty.capacity = 1 << 12;
+        empty.count = 0;
+        ok = ftruncate(fd, fileSize(empty.capacity)) == 0 &&
+             pwrite(fd, &empty, sizeof(empty), 0) == sizeof(empty);
+      }
+      ok = ok && remap() && valid();
+      lock(F_UNLCK);
+      return ok;
+    }
+
+    /// Add h to the table, setting id to the number of reports in it.
+    /// Returns false if h was already in the table. If the table cannot be
+    /// updated, h is considered new.
+    bool add(uint64_t h, unsigned &id) {
+      if (!lock(F_WRLCK))
+        return true;
+
+      bool added = true;
+      if (!remap() || !valid()) {
+        klee_warning_once(this, "invalid race database %s", RaceDatabase.c_str());
+      } else {
+        if (4 * (header->count + 1) > 3 * header->capacity && !grow())
+          klee_warning_once(this, "unable to grow the race database %s: %s",
+                            RaceDatabase.c_str(), strerror(errno));
+        if (header && header->count + 1 < header->capacity) {
+          added = insert(slots(), header->capacity, h);
+          if (added)
+            id = ++header->count;
+        }
+      }
+
+      lock(F_UNLCK);
+      return added;
+    }
+  };
+
+  PersistentReports *persistentReports = 0;
+  bool persistentReportsFailed = false;
+
+  /// Open addressing table of report hashes in memory shared by the workers
+  struct SharedReports {
+    pthread_mutex_t lock;
+    unsigned count;
+    uint64_t hashes[1 << 16];
+  };
+
+  SharedReports *sharedReports = 0;
+}
+
+void RaceReport::shareEmittedReports() {
+  if (sharedReports)
+    return;
+
+  int id = shmget(IPC_PRIVATE, sizeof(SharedReports), IPC_CREAT | 0700);
+  if (id < 0) {
+    klee_warning("unable to share race reports: %s", strerror(errno));
+    return;
+  }
+  void *ptr = shmat(id, NULL, 0);
+  // Released once every worker detaches
+  shmctl(id, IPC_RMID, NULL);
+  if (ptr == (void*) -1) {
+    klee_warning("unable to share race reports: %s", strerror(errno));
+    return;
+  }
+
+  sharedReports = (SharedReports*) ptr;
+  memset(sharedReports, 0, sizeof(SharedReports));
+  pthread_mutexattr_t attr;
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+  pthread_mutex_init(&sharedReports->lock, &attr);
+  pthread_mutexattr_destroy(&attr);
+
+  // Reports emitted before the workers are forked
+  for (std::set<uint64_t>::const_iterator it = emittedReports.begin(),
+       ite = emittedReports.end(); it != ite; ++it) {
+    unsigned dummy;
+    registerShared(*it, dummy);
+  }
+}
+
+bool RaceReport::registerShared(uint64_t h, unsigned &id) {
+  const unsigned size = sizeof(sharedReports->hashes) / sizeof(uint64_t);
+  // Zero marks an empty slot
+  if (h == 0)
+    h = 1;
+
+  bool added = false;
+  pthread_mutex_lock(&sharedReports->lock);
+  for (unsigned i = 0, slot = h % size; i < size; ++i, slot = (slot + 1) % size) {
+    if (sharedReports->hashes[slot] == h)
+      break;
+    if (sharedReports->hashes[slot] == 0) {
+      sharedReports->hashes[slot] = h;
+      id = ++sharedReports->count;
+      added = true;
+      break;
+    }
+  }
+  bool full = !added && sharedReports->count == size;
+  pthread_mutex_unlock(&sharedReports->lock);
+
+  if (full) {
+    klee_warning_once(&sharedReports, "shared race reports table is full");
+    id = emittedReports.size();
     return true;
-  else if (rr.previous < previous)
+  }
+  return added;
+}
+
+bool RaceReport::registerPersistent(uint64_t h, unsigned &id) {
+  if (!persistentReports) {
+    persistentReports = new PersistentReports();
+    if (!persistentReports->open(RaceDatabase)) {
+      klee_warning("unable to open the race database %s: %s",
+                   RaceDatabase.c_str(), strerror(errno));
+      delete persistentReports;
+      persistentReports = 0;
+      persistentReportsFailed = true;
+      id = emittedReports.size();
+      return true;
+    }
+  }
+
+  // Zero marks an empty slot
+  id = emittedReports.size();
+  return persistentReports->add(h ? h : 1, id);
+}
+
+bool RaceReport::registerReport(const RaceReport &rr, unsigned &id) {
+  uint64_t h = rr.hash();
+  if (!emittedReports.insert(h).second)
     return false;
 
-  return false;
+  // The database is shared by the workers too
+  if (!RaceDatabase.empty() && !persistentReportsFailed)
+    return registerPersistent(h, id);
+
+  if (sharedReports)
+    return registerShared(h, id);
+
+  id = emittedReports.size();
+  return true;
+}
+
+uint64_t RaceReport::hash() const {
+  uint64_t h = 14695981039346656037ULL;
+  for (std::string::const_iterator it = allocSite.begin(),
+       ite = allocSite.end(); it != ite; ++it)
+    h = (h ^ (unsigned char) *it) * 1099511628211ULL;
+  // The order of the accesses does not matter
+  return h ^ (current->hash() + previous->hash());
+}
+
+bool RaceReport::operator<(const RaceReport &rr) const {
+  return hash() < rr.hash();
 }
 
 void RaceReport::print(llvm::raw_ostream &os) const {
+  SchedulingHistory::steps_ty steps;
+  schedulingHistory.getSteps(steps);
+
   os << "========\n";
   os << "Race found on: " << allocInfo << "\n";
   os << current << "\n";
   os << "    schedule ";
-  printSchedule(os, current->scheduleIndex, schedulingHistory);
+  printSchedule(os, current->scheduleIndex, steps);
   os << "\n";
   os << "Conflicts with previous operation:\n";
   os << previous << "\n";
   os << "    schedule ";
-  printSchedule(os, previous->scheduleIndex, schedulingHistory);
+  printSchedule(os, previous->scheduleIndex, steps);
   os << "\n";
   os << "========";
 }
 
 void RaceReport::printSchedule(llvm::raw_ostream &os,
-                               std::vector<Thread::thread_id_t>::size_type scheduleIndex,
-                               const std::vector<Thread::thread_id_t> schedulingHistory) const {
-  for (std::vector<Thread::thread_id_t>::size_type i = 0; i < scheduleIndex;) {
-    os << schedulingHistory.at(i);
+                               SchedulingHistory::size_type scheduleIndex,
+                               const SchedulingHistory::steps_ty &steps) const {
+  for (SchedulingHistory::size_type i = 0; i < scheduleIndex;) {
+    os << steps.at(i);
     if (++i < scheduleIndex)
       os << ",";
   }
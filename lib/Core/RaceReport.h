@@ -2,6 +2,7 @@
 #define RACEREPORT_H
 
 #include "MemoryAccessEntry.h"
+#include "SchedulingHistory.h"
 
 #include "llvm/Support/raw_ostream.h"
 
@@ -13,25 +14,47 @@ namespace klee {
 class RaceReport {
 private:
   const std::string allocInfo;
+  const std::string allocSite;
   const ref<MemoryAccessEntry> current;
   const ref<MemoryAccessEntry> previous;
-  const std::vector<Thread::thread_id_t> schedulingHistory;
+  const SchedulingHistory schedulingHistory;
+
+  static bool registerShared(uint64_t hash, unsigned &id);
+
+  static bool registerPersistent(uint64_t hash, unsigned &id);
 
   void printSchedule(llvm::raw_ostream &os,
-                     std::vector<Thread::thread_id_t>::size_type scheduleIndex,
-                     const std::vector<Thread::thread_id_t> schedulingHistory) const;
+                     SchedulingHistory::size_type scheduleIndex,
+                     const SchedulingHistory::steps_ty &steps) const;
 
 public:
-  static std::set<RaceReport> emittedReports;
+  /// Hashes of the reports emitted by this process
+  static std::set<uint64_t> emittedReports;
+
+  /// Register the report as emitted. Returns false if an equivalent report
+  /// was already emitted by this process, by a worker sharing the reports or
+  /// by any run using the same -race-db, otherwise sets id to the number of
+  /// the report.
+  static bool registerReport(const RaceReport &rr, unsigned &id);
 
-  RaceReport(const std::string _allocInfo,
+  /// Share the reports emitted from now on with the worker processes forked
+  /// afterwards
+  static void shareEmittedReports();
+
+  RaceReport(const std::string _allocInfo, const std::string _allocSite,
              const ref<MemoryAccessEntry> &_current, const ref<MemoryAccessEntry> &_previous,
-             const std::vector<Thread::thread_id_t> &_schedulingHistory) :
-             allocInfo(_allocInfo), current(_current), previous(_previous),
+             const SchedulingHistory &_schedulingHistory) :
+             allocInfo(_allocInfo), allocSite(_allocSite),
+             current(_current), previous(_previous),
              schedulingHistory(_schedulingHistory) {}
 
+  /// Reports are ordered by hash, so equivalent reports are equal
   bool operator<(const RaceReport &rr) const;
 
+  /// Hash of the allocation site and of the location and kind of both
+  /// accesses, stable across processes and runs
+  uint64_t hash() const;
+
   void print(llvm::raw_ostream &os) const;
 
 };
@@ -0,0 +1,23 @@
+#include "SchedulePoint.h"
+
+using namespace klee;
+
+void TransitionFootprint::merge(const TransitionFootprint &other) {
+  accesses.insert(accesses.end(), other.accesses.begin(), other.accesses.end());
+  dependsOnAll |= other.dependsOnAll;
+}
+
+bool TransitionFootprint::isIndependent(const TransitionFootprint &other) const {
+  if (dependsOnAll || other.dependsOnAll)
+    return false;
+
+  for (std::vector<ref<MemoryAccessEntry> >::const_iterator it = accesses.begin(),
+       ite = accesses.end(); it != ite; ++it) {
+    for (std::vector<ref<MemoryAccessEntry> >::const_iterator oit = other.accesses.begin(),
+         oite = other.accesses.end(); oit != oite; ++oit) {
+      if ((*it)->mayConflict(**oit))
+        return false;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,63 @@
+#ifndef SCHEDULEPOINT_H
+#define SCHEDULEPOINT_H
+
+#include "MemoryAccessEntry.h"
+#include "Thread.h"
+
+#include "klee/util/Ref.h"
+
+#include <map>
+#include <set>
+#include <vector>
+
+namespace klee {
+class ExecutionState;
+
+/// Memory accesses done by a thread between two scheduling points
+struct TransitionFootprint {
+  std::vector<ref<MemoryAccessEntry> > accesses;
+
+  /// The transition synchronized with other threads or forked, so it is
+  /// considered dependent with any other transition
+  bool dependsOnAll;
+
+  TransitionFootprint() : dependsOnAll(false) {}
+
+  void merge(const TransitionFootprint &other);
+
+  bool isIndependent(const TransitionFootprint &other) const;
+};
+
+/// Scheduling decision point on a path, shared by every state that descends
+/// from it. In DPOR mode the states running the alternative threads are
+/// parked here, and only explored once a dependency shows that they may
+/// lead to a different interleaving.
+class SchedulePoint {
+private:
+  SchedulePoint(const std::set<Thread::thread_id_t> &_enabled)
+      : enabled(_enabled), refCount(0) {}
+
+public:
+  typedef std::map<Thread::thread_id_t, ExecutionState*> parked_ty;
+
+  /// Threads enabled at the decision point
+  const std::set<Thread::thread_id_t> enabled;
+
+  /// States scheduling an alternative thread not yet explored
+  parked_ty parked;
+
+  /// Footprint of the transition run by each thread from this point
+  std::map<Thread::thread_id_t, TransitionFootprint> footprints;
+
+  unsigned refCount;
+
+  static ref<SchedulePoint> create(const std::set<Thread::thread_id_t> &enabled) {
+    return ref<SchedulePoint>(new SchedulePoint(enabled));
+  }
+
+  /// Number of states that reference this point and are not parked in it
+  unsigned liveReferences() const { return refCount - parked.size(); }
+};
+}
+
+#endif // SCHEDULEPOINT_H
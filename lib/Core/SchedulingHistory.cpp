@@ -0,0 +1,45 @@
+#include "SchedulingHistory.h"
+
+#include <cassert>
+
+using namespace klee;
+
+void SchedulingHistory::push_back(Thread::thread_id_t tid) {
+  // Only grow the tail in place if nothing else can see its steps
+  if (tail.isNull() || tail->refCount > 1 ||
+      tail->base + tail->steps.size() != length)
+    tail = ref<Chunk>(new Chunk(tail, length));
+  tail->steps.push_back(tid);
+  ++length;
+}
+
+void SchedulingHistory::pop_back() {
+  assert(length > 0 && "pop_back on empty scheduling history");
+  --length;
+  if (tail->refCount == 1 && tail->base + tail->steps.size() == length + 1)
+    tail->steps.pop_back();
+  // The tail always holds the last step. Keep the parent alive while the
+  // tail is released.
+  if (tail->base == length) {
+    ref<Chunk> parent = tail->parent;
+    tail = parent;
+  }
+}
+
+Thread::thread_id_t SchedulingHistory::at(size_type index) const {
+  assert(index < length && "scheduling history index out of range");
+  const Chunk *c = tail.get();
+  while (index < c->base)
+    c = c->parent.get();
+  return c->steps[index - c->base];
+}
+
+void SchedulingHistory::getSteps(steps_ty &result) const {
+  result.resize(length);
+  size_type end = length;
+  for (const Chunk *c = tail.get(); c; c = c->parent.get()) {
+    for (size_type i = end; i > c->base; --i)
+      result[i - 1] = c->steps[i - 1 - c->base];
+    end = c->base;
+  }
+}
@@ -0,0 +1,59 @@
+#ifndef SCHEDULINGHISTORY_H
+#define SCHEDULINGHISTORY_H
+
+#include "Thread.h"
+
+#include "klee/util/Ref.h"
+
+#include <vector>
+
+namespace klee {
+
+/// Sequence of the threads scheduled along a path.
+///
+/// The steps are stored in chunks linked to the chunk holding the preceding
+/// steps, so the states forked from a common ancestor share the prefix of
+/// their histories. Copying a history is constant time; a chunk is only
+/// appended to in place while no other history or chunk refers to it.
+class SchedulingHistory {
+public:
+  typedef std::vector<Thread::thread_id_t> steps_ty;
+  typedef steps_ty::size_type size_type;
+
+private:
+  struct Chunk {
+    unsigned refCount;
+
+    /// Chunk holding the steps before this one, the first base of them
+    /// belong to the history
+    ref<Chunk> parent;
+    size_type base;
+
+    steps_ty steps;
+
+    Chunk(const ref<Chunk> &_parent, size_type _base)
+        : refCount(0), parent(_parent), base(_base) {}
+  };
+
+  /// Chunk holding the last step, null if the history is empty
+  ref<Chunk> tail;
+  size_type length;
+
+public:
+  SchedulingHistory() : length(0) {}
+
+  size_type size() const { return length; }
+  bool empty() const { return length == 0; }
+
+  void push_back(Thread::thread_id_t tid);
+  void pop_back();
+
+  /// Thread scheduled at step \a index. Linear in the number of chunks.
+  Thread::thread_id_t at(size_type index) const;
+
+  /// Materialize the steps, oldest first
+  void getSteps(steps_ty &result) const;
+};
+}
+
+#endif // SCHEDULINGHISTORY_H
@@ -43,6 +43,7 @@
 #endif
 
 #include <cassert>
+#include <cmath>
 #include <fstream>
 #include <climits>
 
@@ -173,6 +174,7 @@ WeightedRandomSearcher::WeightedRandomSearcher(WeightType _type)
   case QueryCost:
   case MinDistToUncovered:
   case CoveringNew:
+  case Races:
     updateWeights = true;
     break;
   default:
@@ -222,6 +224,28 @@ double WeightedRandomSearcher::getWeight(ExecutionState *es) {
       return invMD2U * invMD2U;
     }
   }
+  case Races: {
+    // Unordered conflicting accesses on the path, with diminishing returns
+    double conflicts = std::sqrt((double) es->unorderedConflicts);
+
+    // Paths that recently reported new races, as CoveringNew does for
+    // coverage
+    double invNewRace = 0.;
+    if (es->instsSinceNewRace)
+      invNewRace = 1. / std::max(1, (int) es->instsSinceNewRace - 1000);
+
+    // Blocked threads can not be interleaved with the running ones
+    unsigned blocked = 0;
+    for (ExecutionState::wlists_ty::iterator it = es->waitingLists.begin(),
+         ie = es->waitingLists.end(); it != ie; ++it)
+      blocked += it->second.size();
+    double runnable = std::max(1., (double) es->threads.size() - blocked);
+
+    // Paths with fewer preemptions have more of the bound left to reorder
+    // their accesses
+    return (1. + conflicts) * (1. + invNewRace) * runnable /
+           (1. + es->preemptions);
+  }
   }
 }
 
@@ -591,6 +615,71 @@ void IterativeDeepeningTimeSearcher::update(ExecutionState *current,
 
 /***/
 
+IterativeContextBoundingSearcher::IterativeContextBoundingSearcher(Searcher *_baseSearcher)
+  : baseSearcher(_baseSearcher),
+    bound(0) {
+}
+
+IterativeContextBoundingSearcher::~IterativeContextBoundingSearcher() {
+  delete baseSearcher;
+}
+
+bool IterativeContextBoundingSearcher::isPaused(ExecutionState *es) {
+  // Paused states do not run, so their number of preemptions does not change
+  std::map<unsigned, std::set<ExecutionState*> >::iterator it =
+    pausedStates.find(es->preemptions);
+  return it != pausedStates.end() && it->second.count(es);
+}
+
+ExecutionState &IterativeContextBoundingSearcher::selectState() {
+  return baseSearcher->selectState();
+}
+
+void IterativeContextBoundingSearcher::update(ExecutionState *current,
+                                              const std::set<ExecutionState*> &addedStates,
+                                              const std::set<ExecutionState*> &removedStates) {
+  std::set<ExecutionState*> added, removed;
+  for (std::set<ExecutionState*>::const_iterator it = addedStates.begin(),
+         ie = addedStates.end(); it != ie; ++it) {
+    ExecutionState *es = *it;
+    if (es->preemptions > bound)
+      pausedStates[es->preemptions].insert(es);
+    else
+      added.insert(es);
+  }
+
+  for (std::set<ExecutionState*>::const_iterator it = removedStates.begin(),
+         ie = removedStates.end(); it != ie; ++it) {
+    ExecutionState *es = *it;
+    if (isPaused(es)) {
+      pausedStates[es->preemptions].erase(es);
+      if (pausedStates[es->preemptions].empty())
+        pausedStates.erase(es->preemptions);
+    } else {
+      removed.insert(es);
+    }
+  }
+
+  baseSearcher->update(current, added, removed);
+
+  if (current && !removedStates.count(current) && !isPaused(current) &&
+      current->preemptions > bound) {
+    pausedStates[current->preemptions].insert(current);
+    baseSearcher->removeState(current);
+  }
+
+  if (baseSearcher->empty() && !pausedStates.empty()) {
+    std::map<unsigned, std::set<ExecutionState*> >::iterator it =
+      pausedStates.begin();
+    bound = it->first;
+    llvm::errs() << "KLEE: increasing preemption bound to: " << bound << "\n";
+    baseSearcher->update(0, it->second, std::set<ExecutionState*>());
+    pausedStates.erase(it);
+  }
+}
+
+/***/
+
 InterleavedSearcher::InterleavedSearcher(const std::vector<Searcher*> &_searchers)
   : searchers(_searchers),
     index(1) {
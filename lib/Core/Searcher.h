@@ -76,7 +76,8 @@ namespace klee {
       NURS_Depth,
       NURS_ICnt,
       NURS_CPICnt,
-      NURS_QC
+      NURS_QC,
+      NURS_Race
     };
   };
 
@@ -130,7 +131,8 @@ namespace klee {
       InstCount,
       CPInstCount,
       MinDistToUncovered,
-      CoveringNew
+      CoveringNew,
+      Races
     };
 
   private:
@@ -158,6 +160,7 @@ namespace klee {
       case CPInstCount        : os << "CPInstCount\n"; return;
       case MinDistToUncovered : os << "MinDistToUncovered\n"; return;
       case CoveringNew        : os << "CoveringNew\n"; return;
+      case Races              : os << "Races\n"; return;
       default                 : os << "<unknown type>\n"; return;
       }
     }
@@ -274,6 +277,33 @@ namespace klee {
     }
   };
 
+  /// Explores the states with at most 0 preemptions first, then with at most
+  /// 1, and so on. The states over the current bound are paused until the
+  /// ones within it are exhausted.
+  class IterativeContextBoundingSearcher : public Searcher {
+    Searcher *baseSearcher;
+    unsigned bound;
+    /// Paused states, by number of preemptions
+    std::map<unsigned, std::set<ExecutionState*> > pausedStates;
+
+    bool isPaused(ExecutionState *es);
+
+  public:
+    IterativeContextBoundingSearcher(Searcher *baseSearcher);
+    ~IterativeContextBoundingSearcher();
+
+    ExecutionState &selectState();
+    void update(ExecutionState *current,
+                const std::set<ExecutionState*> &addedStates,
+                const std::set<ExecutionState*> &removedStates);
+    bool empty() { return baseSearcher->empty() && pausedStates.empty(); }
+    void printName(llvm::raw_ostream &os) {
+      os << "<IterativeContextBoundingSearcher> containing:\n";
+      baseSearcher->printName(os);
+      os << "</IterativeContextBoundingSearcher>\n";
+    }
+  };
+
   class InterleavedSearcher : public Searcher {
     typedef std::vector<Searcher*> searchers_ty;
 
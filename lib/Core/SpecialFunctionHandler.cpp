@@ -9,6 +9,7 @@
 
 #include "Common.h"
 
+#include "CoreStats.h"
 #include "Memory.h"
 #include "SpecialFunctionHandler.h"
 #include "TimingSolver.h"
@@ -28,8 +29,10 @@
 #if LLVM_VERSION_CODE >= LLVM_VERSION(3, 3)
 #include "llvm/IR/Module.h"
 #include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Metadata.h"
 #else
 #include "llvm/Module.h"
+#include "llvm/Metadata.h"
 #include "llvm/Type.h"
 #include "llvm/DerivedTypes.h"
 #include "llvm/InstrTypes.h"
@@ -111,7 +114,12 @@ static SpecialFunctionHandler::HandlerInfo handlerInfo[] = {
   add("klee_thread_preempt", handleThreadPreempt, false),
   add("klee_thread_sleep", handleThreadSleep, false),
   add("klee_vclock_send", handleVectorClockSend, false),
+  add("klee_vclock_acquire", handleVectorClockAcquire, false),
+  add("klee_vclock_release", handleVectorClockRelease, false),
+  add("klee_vclock_fork", handleVectorClockFork, false),
+  add("klee_vclock_clear", handleVectorClockClear, false),
   add("klee_mem_access", handleMemoryAccess, false),
+  add("klee_mem_access_range", handleMemoryAccessRange, false),
   add("klee_lockset_update", handleLocksetUpdate, false),
   add("klee_get_time", handleGetTime, true),
   add("klee_set_time", handleSetTime, false),
@@ -846,7 +854,20 @@ void SpecialFunctionHandler::handleThreadPreempt(ExecutionState &state,
     executor.terminateStateOnError(state, "klee_thread_preempt", "user.err");
   }
 
+  uint64_t forks = stats::scheduleForks;
   executor.schedule(state, !arguments[0]->isZero(), false);
+
+  // Account the states forked to the kind of preemption point
+  if (MDNode *kind = target->inst->getMetadata("klee.preempt")) {
+    uint64_t forked = stats::scheduleForks - forks;
+    MDString *name = dyn_cast_or_null<MDString>(kind->getOperand(0));
+    if (!name || name->getString() == "pthread")
+      stats::preemptionStatesPthread += forked;
+    else if (name->getString() == "access")
+      stats::preemptionStatesAccess += forked;
+    else if (name->getString() == "atomic")
+      stats::preemptionStatesAtomic += forked;
+  }
 }
 
 void SpecialFunctionHandler::handleThreadSleep(ExecutionState &state,
@@ -862,7 +883,11 @@ void SpecialFunctionHandler::handleThreadSleep(ExecutionState &state,
     return;
   }
 
-  state.sleepThread(cast<ConstantExpr>(wlistExpr)->getZExtValue());
+  uint64_t wlist = cast<ConstantExpr>(wlistExpr)->getZExtValue();
+  state.transitionSynchronizes = true;
+  executor.handleSyncDependencies(state, state.waitListOperations, wlist,
+                                  state.crtThread().getTid());
+  state.sleepThread(wlist);
   executor.schedule(state, false, false);
 }
 
@@ -879,6 +904,11 @@ void SpecialFunctionHandler::handleThreadNotify(ExecutionState &state,
     return;
   }
 
+  state.transitionSynchronizes = true;
+  executor.handleSyncDependencies(state, state.waitListOperations,
+                                  cast<ConstantExpr>(wlist)->getZExtValue(),
+                                  state.crtThread().getTid());
+
   if (all->isZero()) {
     executor.executeThreadNotifyOne(state, cast<ConstantExpr>(wlist)->getZExtValue());
   } else {
@@ -975,6 +1005,53 @@ void SpecialFunctionHandler::handleVectorClockSend(ExecutionState &state, KInstr
   delete[] vc;
 }
 
+void SpecialFunctionHandler::handleVectorClockAcquire(ExecutionState &state, KInstruction *target,
+                                                      std::vector<ref<Expr> > &arguments) {
+  assert(arguments.size() == 1 && "invalid number of arguments to klee_vclock_acquire");
+
+  uint64_t sync = cast<ConstantExpr>(executor.toUnique(state, arguments[0]))->getZExtValue();
+
+  state.acquireVectorClock(sync);
+  // Runtime synchronization objects are not instrumented, so their
+  // operations are dependent on every other transition
+  state.transitionSynchronizes = true;
+}
+
+void SpecialFunctionHandler::handleVectorClockRelease(ExecutionState &state, KInstruction *target,
+                                                      std::vector<ref<Expr> > &arguments) {
+  assert(arguments.size() == 2 && "invalid number of arguments to klee_vclock_release");
+
+  uint64_t sync = cast<ConstantExpr>(executor.toUnique(state, arguments[0]))->getZExtValue();
+
+  bool merge = cast<ConstantExpr>(executor.toUnique(state, arguments[1]))->getZExtValue();
+
+  state.releaseVectorClock(sync, merge);
+  state.transitionSynchronizes = true;
+}
+
+void SpecialFunctionHandler::handleVectorClockFork(ExecutionState &state, KInstruction *target,
+                                                   std::vector<ref<Expr> > &arguments) {
+  assert(arguments.size() == 1 && "invalid number of arguments to klee_vclock_fork");
+
+  uint64_t threadId = cast<ConstantExpr>(executor.toUnique(state, arguments[0]))->getZExtValue();
+
+  if (!state.threads.count(threadId)) {
+    executor.terminateStateOnError(state, "klee_vclock_fork on unknown thread", "user.err");
+    return;
+  }
+  state.forkVectorClock(threadId);
+}
+
+void SpecialFunctionHandler::handleVectorClockClear(ExecutionState &state, KInstruction *target,
+                                                    std::vector<ref<Expr> > &arguments) {
+  assert(arguments.size() == 1 && "invalid number of arguments to klee_vclock_clear");
+
+  uint64_t sync = cast<ConstantExpr>(executor.toUnique(state, arguments[0]))->getZExtValue();
+
+  state.clearVectorClock(sync);
+  state.transitionSynchronizes = true;
+}
+
 void SpecialFunctionHandler::handleMemoryAccess(ExecutionState &state, KInstruction *target,
                                                 std::vector<ref<Expr> > &arguments) {
   assert(arguments.size() == 5 && "invalid number of arguments to klee_mem_access");
@@ -987,17 +1064,61 @@ void SpecialFunctionHandler::handleMemoryAccess(ExecutionState &state, KInstruct
 
   bool isRaceCandidate = cast<ConstantExpr>(executor.toUnique(state, arguments[4]))->getZExtValue();
 
-  ref<Expr> address = executor.toUnique(state, arguments[0]);
+  executor.executeMemoryAccess(state, target, arguments[0], bytes, isWrite, isAtomic, isRaceCandidate);
+}
+
+void SpecialFunctionHandler::handleMemoryAccessRange(ExecutionState &state, KInstruction *target,
+                                                     std::vector<ref<Expr> > &arguments) {
+  assert(arguments.size() == 6 && "invalid number of arguments to klee_mem_access_range");
+
+  uint64_t bytes = cast<ConstantExpr>(executor.toUnique(state, arguments[1]))->getZExtValue();
+
+  ref<ConstantExpr> strideExpr = cast<ConstantExpr>(executor.toUnique(state, arguments[2]));
+  int64_t stride = strideExpr->getAPValue().getSExtValue();
+
+  // The loop already ran, so its path constraints usually fix the count
+  ref<Expr> countExpr = executor.toUnique(state, arguments[3]);
+  if (!isa<ConstantExpr>(countExpr))
+    countExpr = executor.toConstant(state, countExpr, "klee_mem_access_range");
+  uint64_t count = cast<ConstantExpr>(countExpr)->getZExtValue();
+
+  bool isWrite = cast<ConstantExpr>(executor.toUnique(state, arguments[4]))->getZExtValue();
+
+  bool isRaceCandidate = cast<ConstantExpr>(executor.toUnique(state, arguments[5]))->getZExtValue();
+
+  if (!count || !bytes)
+    return;
+
+  // Element accesses go down from the base with a negative stride
+  ref<Expr> base = executor.toUnique(state, arguments[0]);
+  uint64_t absStride = stride < 0 ? -(uint64_t) stride : stride;
+  ref<Expr> low = base;
+  if (stride < 0)
+    low = SubExpr::create(base, ConstantExpr::create((count - 1) * absStride,
+                                                     base->getWidth()));
+
+  // Elements without gaps between them are logged as a single access
+  bool contiguous = absStride <= bytes;
+  uint64_t span = contiguous ? (count - 1) * absStride + bytes : bytes;
 
   ResolutionList rl;
-  state.addressSpace.resolve(state, executor.solver, address, rl, 0, executor.coreSolverTimeout);
+  state.addressSpace.resolve(state, executor.solver, low, rl, 0, executor.coreSolverTimeout);
   for (ResolutionList::iterator it = rl.begin(), ie = rl.end(); it != ie; ++it) {
-    bool res;
-    assert(executor.solver->mustBeTrue(state, it->first->getBoundsCheckPointer(address, bytes),
-                                       res) &&
-           res &&
-           "XXX array size out of bounds");
-    executor.logMemoryAccess(state, address, bytes, isWrite, isAtomic, it->first, target, isRaceCandidate);
+    if (contiguous) {
+      bool res;
+      assert(executor.solver->mustBeTrue(state, it->first->getBoundsCheckPointer(low, span),
+                                         res) &&
+             res &&
+             "XXX array size out of bounds");
+      executor.logMemoryAccess(state, low, span - 1, isWrite, false, it->first, target, isRaceCandidate);
+      continue;
+    }
+
+    for (uint64_t i = 0; i < count; ++i) {
+      ref<Expr> address = AddExpr::create(low, ConstantExpr::create(i * absStride,
+                                                                    low->getWidth()));
+      executor.logMemoryAccess(state, address, bytes - 1, isWrite, false, it->first, target, isRaceCandidate);
+    }
   }
 }
 
@@ -1014,4 +1135,8 @@ void SpecialFunctionHandler::handleLocksetUpdate(ExecutionState &state, KInstruc
   bool isWriteMode = cast<ConstantExpr>(executor.toUnique(state, arguments[3]))->getZExtValue();
 
   state.updateLockset(threadId, address, isAcquire, isWriteMode);
+  state.transitionSynchronizes = true;
+
+  if (isAcquire)
+    executor.handleSyncDependencies(state, state.lockOperations, address, threadId);
 }
@@ -144,7 +144,12 @@ namespace klee {
     HANDLER(handleThreadTerminate);
     HANDLER(handleUnderConstrained);
     HANDLER(handleVectorClockSend);
+    HANDLER(handleVectorClockAcquire);
+    HANDLER(handleVectorClockRelease);
+    HANDLER(handleVectorClockFork);
+    HANDLER(handleVectorClockClear);
     HANDLER(handleMemoryAccess);
+    HANDLER(handleMemoryAccessRange);
     HANDLER(handleLocksetUpdate);
     HANDLER(handleWarning);
     HANDLER(handleWarningOnce);
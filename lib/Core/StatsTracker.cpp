@@ -23,6 +23,7 @@
 #include "CallPathManager.h"
 #include "CoreStats.h"
 #include "Executor.h"
+#include "MemoryAccessEntry.h"
 #include "MemoryManager.h"
 #include "Thread.h"
 #include "UserSearcher.h"
@@ -45,6 +46,7 @@
 #include "llvm/Module.h"
 #include "llvm/Type.h"
 #endif
+#include "llvm/ADT/StringExtras.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Process.h"
 #include "llvm/Support/Path.h"
@@ -265,6 +267,24 @@ void StatsTracker::done() {
     writeIStats();
 }
 
+void StatsTracker::setWorker(unsigned index) {
+  std::string suffix = ".worker" + llvm::utostr(index);
+
+  if (statsFile) {
+    delete statsFile;
+    statsFile = executor.interpreterHandler->openOutputFile("run" + suffix + ".stats");
+    assert(statsFile && "unable to open statistics trace file");
+    writeStatsHeader();
+    writeStatsLine();
+  }
+
+  if (istatsFile) {
+    delete istatsFile;
+    istatsFile = executor.interpreterHandler->openOutputFile("run" + suffix + ".istats");
+    assert(istatsFile && "unable to open istats file");
+  }
+}
+
 void StatsTracker::stepInstruction(ExecutionState &es) {
   if (OutputIStats) {
     if (TrackInstructionTime) {
@@ -393,6 +413,18 @@ void StatsTracker::writeStatsHeader() {
              << "'CexCacheTime',"
              << "'ForkTime',"
              << "'ResolveTime',"
+             << "'MemoryAccesses',"
+             << "'RaceCandidates',"
+             << "'RaceOrderedCandidates',"
+             << "'RaceLockedCandidates',"
+             << "'OverlapQueries',"
+             << "'OverlapTime',"
+             << "'RaceDetectionTime',"
+             << "'AccessHistoryBytes',"
+             << "'ScheduleForks',"
+             << "'PreemptionStatesPthread',"
+             << "'PreemptionStatesAccess',"
+             << "'PreemptionStatesAtomic',"
 #ifdef DEBUG
 	     << "'ArrayHashTime',"
 #endif
@@ -404,6 +436,15 @@ double StatsTracker::elapsed() {
   return util::getWallTime() - startWallTime;
 }
 
+uint64_t StatsTracker::getAccessHistoryBytes() {
+  // Entries shared by several states are counted once per state
+  uint64_t entries = 0;
+  for (std::set<ExecutionState*>::const_iterator it = executor.states.begin(),
+       ie = executor.states.end(); it != ie; ++it)
+    entries += (*it)->memoryAccesses.size();
+  return entries * (sizeof(MemoryAccessEntry) + sizeof(ref<MemoryAccessEntry>));
+}
+
 void StatsTracker::writeStatsLine() {
   *statsFile << "(" << stats::instructions
              << "," << fullBranches
@@ -427,6 +468,18 @@ void StatsTracker::writeStatsLine() {
              << "," << stats::cexCacheTime / 1000000.
              << "," << stats::forkTime / 1000000.
              << "," << stats::resolveTime / 1000000.
+             << "," << stats::memoryAccesses
+             << "," << stats::raceCandidates
+             << "," << stats::raceOrderedCandidates
+             << "," << stats::raceLockedCandidates
+             << "," << stats::overlapQueries
+             << "," << stats::overlapTime / 1000000.
+             << "," << stats::raceDetectionTime / 1000000.
+             << "," << getAccessHistoryBytes()
+             << "," << stats::scheduleForks
+             << "," << stats::preemptionStatesPthread
+             << "," << stats::preemptionStatesAccess
+             << "," << stats::preemptionStatesAtomic
 #ifdef DEBUG
              << "," << stats::arrayHashTime / 1000000.
 #endif
@@ -464,25 +517,33 @@ void StatsTracker::writeIStats() {
   StatisticManager &sm = *theStatisticManager;
   unsigned nStats = sm.getNumStatistics();
 
-  // Max is 13, sadly
-  istatsMask |= 1<<sm.getStatisticID("Queries");
-  istatsMask |= 1<<sm.getStatisticID("QueriesValid");
-  istatsMask |= 1<<sm.getStatisticID("QueriesInvalid");
-  istatsMask |= 1<<sm.getStatisticID("QueryTime");
-  istatsMask |= 1<<sm.getStatisticID("ResolveTime");
-  istatsMask |= 1<<sm.getStatisticID("Instructions");
-  istatsMask |= 1<<sm.getStatisticID("InstructionTimes");
-  istatsMask |= 1<<sm.getStatisticID("InstructionRealTimes");
-  istatsMask |= 1<<sm.getStatisticID("Forks");
-  istatsMask |= 1<<sm.getStatisticID("CoveredInstructions");
-  istatsMask |= 1<<sm.getStatisticID("UncoveredInstructions");
-  istatsMask |= 1<<sm.getStatisticID("States");
-  istatsMask |= 1<<sm.getStatisticID("MinDistToUncovered");
+  // The ids of the statistics reported must fit in the 64-bit mask
+  istatsMask |= (uint64_t) 1<<sm.getStatisticID("Queries");
+  istatsMask |= (uint64_t) 1<<sm.getStatisticID("QueriesValid");
+  istatsMask |= (uint64_t) 1<<sm.getStatisticID("QueriesInvalid");
+  istatsMask |= (uint64_t) 1<<sm.getStatisticID("QueryTime");
+  istatsMask |= (uint64_t) 1<<sm.getStatisticID("ResolveTime");
+  istatsMask |= (uint64_t) 1<<sm.getStatisticID("Instructions");
+  istatsMask |= (uint64_t) 1<<sm.getStatisticID("InstructionTimes");
+  istatsMask |= (uint64_t) 1<<sm.getStatisticID("InstructionRealTimes");
+  istatsMask |= (uint64_t) 1<<sm.getStatisticID("Forks");
+  istatsMask |= (uint64_t) 1<<sm.getStatisticID("CoveredInstructions");
+  istatsMask |= (uint64_t) 1<<sm.getStatisticID("UncoveredInstructions");
+  istatsMask |= (uint64_t) 1<<sm.getStatisticID("States");
+  istatsMask |= (uint64_t) 1<<sm.getStatisticID("MinDistToUncovered");
+  // Race detection costs, attributed to the instrumented accesses
+  istatsMask |= (uint64_t) 1<<sm.getStatisticID("MemoryAccesses");
+  istatsMask |= (uint64_t) 1<<sm.getStatisticID("RaceCandidates");
+  istatsMask |= (uint64_t) 1<<sm.getStatisticID("OverlapQueries");
+  istatsMask |= (uint64_t) 1<<sm.getStatisticID("OverlapTime");
+  istatsMask |= (uint64_t) 1<<sm.getStatisticID("RaceDetectionTime");
+  // States forked at each preemption point
+  istatsMask |= (uint64_t) 1<<sm.getStatisticID("ScheduleForks");
 
   of << "positions: instr line\n";
 
   for (unsigned i=0; i<nStats; i++) {
-    if (istatsMask & (1<<i)) {
+    if (istatsMask & ((uint64_t) 1<<i)) {
       Statistic &s = sm.getStatistic(i);
       of << "event: " << s.getShortName() << " : " 
          << s.getName() << "\n";
@@ -491,14 +552,14 @@ void StatsTracker::writeIStats() {
 
   of << "events: ";
   for (unsigned i=0; i<nStats; i++) {
-    if (istatsMask & (1<<i))
+    if (istatsMask & ((uint64_t) 1<<i))
       of << sm.getStatistic(i).getShortName() << " ";
   }
   of << "\n";
   
   // set state counts, decremented after we process so that we don't
   // have to zero all records each time.
-  if (istatsMask & (1<<stats::states.getID()))
+  if (istatsMask & ((uint64_t) 1<<stats::states.getID()))
     updateStateStatistics(1);
 
   std::string sourceFile = "";
@@ -536,7 +597,7 @@ void StatsTracker::writeIStats() {
           of << ii.assemblyLine << " ";
           of << ii.line << " ";
           for (unsigned i=0; i<nStats; i++)
-            if (istatsMask&(1<<i))
+            if (istatsMask & ((uint64_t) 1<<i))
               of << sm.getIndexedValue(sm.getStatistic(i), index) << " ";
           of << "\n";
 
@@ -562,7 +623,7 @@ void StatsTracker::writeIStats() {
                 of << ii.assemblyLine << " ";
                 of << ii.line << " ";
                 for (unsigned i=0; i<nStats; i++) {
-                  if (istatsMask&(1<<i)) {
+                  if (istatsMask & ((uint64_t) 1<<i)) {
                     Statistic &s = sm.getStatistic(i);
                     uint64_t value;
 
@@ -586,7 +647,7 @@ void StatsTracker::writeIStats() {
     }
   }
 
-  if (istatsMask & (1<<stats::states.getID()))
+  if (istatsMask & ((uint64_t) 1<<stats::states.getID()))
     updateStateStatistics((uint64_t)-1);
   
   // Clear then end of the file if necessary (no truncate op?).
@@ -76,6 +76,9 @@ namespace klee {
     // called when execution is done and stats files should be flushed
     void done();
 
+    // called in a forked worker process, which writes its own stats files
+    void setWorker(unsigned index);
+
     // process stats for a single instruction step, es is the state
     // about to be stepped
     void stepInstruction(ExecutionState &es);
@@ -83,6 +86,9 @@ namespace klee {
     /// Return time in seconds since execution start.
     double elapsed();
 
+    /// Return the memory taken by the access histories of the live states.
+    uint64_t getAccessHistoryBytes();
+
     void computeReachableUncovered();
   };
 
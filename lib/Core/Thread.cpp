@@ -73,7 +73,7 @@ StackFrame::~StackFrame() {
 /* Thread class methods */
 
 Thread::Thread(thread_id_t tid, KFunction * kf)
-  : enabled(true), waitingList(0) {
+  : enabled(true), waitingList(0), refCount(0), copyOnWriteOwner(0) {
 
   this->tid = tid;
   if (kf) {
@@ -87,3 +87,18 @@ Thread::Thread(thread_id_t tid, KFunction * kf)
   lockset = Lockset::create();
   writeLockset = Lockset::create();
 }
+
+Thread::Thread(const Thread &t)
+  : pc(t.pc),
+    prevPC(t.prevPC),
+    incomingBBIndex(t.incomingBBIndex),
+    stack(t.stack),
+    enabled(t.enabled),
+    waitingList(t.waitingList),
+    tid(t.tid),
+    vc(t.vc),
+    lockset(t.lockset),
+    writeLockset(t.writeLockset),
+    refCount(0),
+    copyOnWriteOwner(0) {
+}
@@ -89,9 +89,13 @@ struct StackFrame {
   ~StackFrame();
 };
 
+/// Threads are shared between the states forked from a common ancestor and
+/// only copied when a state modifies them, see
+/// ExecutionState::getWriteableThread.
 class Thread {
   friend class Executor;
   friend class ExecutionState;
+  friend class ref<Thread>;
 
 public:
   typedef std::vector<StackFrame> stack_ty;
@@ -114,8 +118,15 @@ private:
   ref<Lockset> lockset;
   ref<Lockset> writeLockset;
 
+  unsigned refCount;
+  unsigned copyOnWriteOwner; // exclusively for ExecutionState
+
+  // unsupported, use copy constructor
+  Thread &operator=(const Thread &);
+
 public:
   Thread(thread_id_t tid, KFunction *start_function);
+  Thread(const Thread &t);
 
   thread_id_t getTid() const { return tid; }
 
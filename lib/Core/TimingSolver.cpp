@@ -12,6 +12,7 @@
 #include "klee/Config/Version.h"
 #include "klee/ExecutionState.h"
 #include "klee/Solver.h"
+#include "klee/SolverImpl.h"
 #include "klee/Statistics.h"
 #include "klee/Internal/System/Time.h"
 
@@ -139,6 +140,30 @@ TimingSolver::getInitialValues(const ExecutionState& state,
   return success;
 }
 
+bool
+TimingSolver::getCounterexample(const ExecutionState& state, ref<Expr> expr,
+                                const std::vector<const Array*> &objects,
+                                std::vector< std::vector<unsigned char> >
+                                  &result,
+                                bool &hasSolution) {
+  sys::TimeValue now = util::getWallTimeVal();
+
+  if (simplifyExprs)
+    expr = state.constraints.simplifyExpr(expr);
+
+  // Unlike Solver::getInitialValues(), tell a valid expression apart from a
+  // failure
+  bool success = solver->impl->computeInitialValues(Query(state.constraints, expr),
+                                                    objects, result, hasSolution);
+
+  sys::TimeValue delta = util::getWallTimeVal();
+  delta -= now;
+  stats::solverTime += delta.usec();
+  state.queryCost += delta.usec()/1000000.;
+
+  return success;
+}
+
 std::pair< ref<Expr>, ref<Expr> >
 TimingSolver::getRange(const ExecutionState& state, ref<Expr> expr) {
   return solver->getRange(Query(state.constraints, expr));
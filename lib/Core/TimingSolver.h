@@ -63,6 +63,14 @@ namespace klee {
                           const std::vector<const Array*> &objects,
                           std::vector< std::vector<unsigned char> > &result);
 
+    /// Compute the initial values of \a objects for an assignment which
+    /// satisfies the constraints of the state but not \a expr. \a hasSolution
+    /// is set to false if \a expr must be true.
+    bool getCounterexample(const ExecutionState&, ref<Expr> expr,
+                           const std::vector<const Array*> &objects,
+                           std::vector< std::vector<unsigned char> > &result,
+                           bool &hasSolution);
+
     std::pair< ref<Expr>, ref<Expr> >
     getRange(const ExecutionState&, ref<Expr> query);
   };
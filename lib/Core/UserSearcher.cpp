@@ -32,12 +32,18 @@ namespace {
 			clEnumValN(Searcher::NURS_ICnt, "nurs:icnt", "use NURS with Instr-Count"),
 			clEnumValN(Searcher::NURS_CPICnt, "nurs:cpicnt", "use NURS with CallPath-Instr-Count"),
 			clEnumValN(Searcher::NURS_QC, "nurs:qc", "use NURS with Query-Cost"),
+			clEnumValN(Searcher::NURS_Race, "nurs:race", "use NURS with unordered conflicting accesses, new races, runnable threads and preemptions"),
 			clEnumValEnd));
 
   cl::opt<bool>
   UseIterativeDeepeningTimeSearch("use-iterative-deepening-time-search", 
                                     cl::desc("(experimental)"));
 
+  cl::opt<bool>
+  UseIterativeContextBounding("use-iterative-context-bounding",
+                              cl::desc("Explore the schedules with 0 preemptions first, then with 1, and so on (implies --no-scheduler-bound, default search=dfs)"),
+                              cl::init(false));
+
   cl::opt<bool>
   UseBatchingSearch("use-batching-search", 
 		    cl::desc("Use batching searcher (keep running selected state for N instructions/time, see --batch-instructions and --batch-time)"),
@@ -73,6 +79,10 @@ bool klee::userSearcherRequiresMD2U() {
 	  std::find(CoreSearch.begin(), CoreSearch.end(), Searcher::NURS_QC) != CoreSearch.end());
 }
 
+bool klee::userSearcherUnboundedPreemptions() {
+  return UseIterativeContextBounding;
+}
+
 
 Searcher *getNewSearcher(Searcher::CoreSearchType type, Executor &executor) {
   Searcher *searcher = NULL;
@@ -87,6 +97,7 @@ Searcher *getNewSearcher(Searcher::CoreSearchType type, Executor &executor) {
   case Searcher::NURS_ICnt: searcher = new WeightedRandomSearcher(WeightedRandomSearcher::InstCount); break;
   case Searcher::NURS_CPICnt: searcher = new WeightedRandomSearcher(WeightedRandomSearcher::CPInstCount); break;
   case Searcher::NURS_QC: searcher = new WeightedRandomSearcher(WeightedRandomSearcher::QueryCost); break;
+  case Searcher::NURS_Race: searcher = new WeightedRandomSearcher(WeightedRandomSearcher::Races); break;
   }
 
   return searcher;
@@ -96,10 +107,20 @@ Searcher *klee::constructUserSearcher(Executor &executor) {
 
   // default values
   if (CoreSearch.size() == 0) {
-    CoreSearch.push_back(Searcher::RandomPath);
-    CoreSearch.push_back(Searcher::NURS_CovNew);
+    if (UseIterativeContextBounding) {
+      CoreSearch.push_back(Searcher::DFS);
+    } else {
+      CoreSearch.push_back(Searcher::RandomPath);
+      CoreSearch.push_back(Searcher::NURS_CovNew);
+    }
   }
 
+  // The random path searcher selects through the process tree, so it would
+  // also pick the states paused over the preemption bound
+  if (UseIterativeContextBounding &&
+      std::find(CoreSearch.begin(), CoreSearch.end(), Searcher::RandomPath) != CoreSearch.end())
+    klee_error("--use-iterative-context-bounding is not compatible with --search=random-path");
+
   Searcher *searcher = getNewSearcher(CoreSearch[0], executor);
   
   if (CoreSearch.size() > 1) {
@@ -129,6 +150,10 @@ Searcher *klee::constructUserSearcher(Executor &executor) {
     searcher = new IterativeDeepeningTimeSearcher(searcher);
   }
 
+  if (UseIterativeContextBounding) {
+    searcher = new IterativeContextBoundingSearcher(searcher);
+  }
+
   llvm::raw_ostream &os = executor.getHandler().getInfoStream();
 
   os << "BEGIN searcher description\n";
@@ -17,6 +17,9 @@ namespace klee {
   // XXX gross, should be on demand?
   bool userSearcherRequiresMD2U();
 
+  /// The searcher bounds the preemptions itself, so the scheduler must not
+  bool userSearcherUnboundedPreemptions();
+
   Searcher *constructUserSearcher(Executor &executor);
 }
 
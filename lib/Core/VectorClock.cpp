@@ -1,48 +1,157 @@
 #include "VectorClock.h"
 
+#include <ciso646>
+#ifdef _LIBCPP_VERSION
+#include <unordered_set>
+#define unordered_set std::unordered_set
+#else
+#include <tr1/unordered_set>
+#define unordered_set std::tr1::unordered_set
+#endif
+
 using namespace klee;
 
+namespace {
+  struct VectorClockHash {
+    unsigned operator()(const VectorClock *vc) const {
+      return vc->hash();
+    }
+  };
+
+  struct VectorClockEq {
+    bool operator()(const VectorClock *a, const VectorClock *b) const {
+      return a->compare(*b) == 0;
+    }
+  };
+
+  typedef unordered_set<VectorClock*, VectorClockHash, VectorClockEq> clock_table_t;
+
+  // Table of live clocks, used to share identical ones. Never freed, as
+  // clocks may outlive it during static destruction.
+  clock_table_t &getClockTable() {
+    static clock_table_t *table = new clock_table_t();
+    return *table;
+  }
+}
+
+VectorClock::VectorClock(const std::vector<clock_counter_t> &_clocks)
+    : epoch(true), epochIndex(0), epochClock(0), refCount(0) {
+  hashValue = 0;
+  for (index_t i = 0; i < _clocks.size(); ++i) {
+    if (!_clocks[i])
+      continue;
+    hashValue = (hashValue * 31) ^ ((i << 16) + _clocks[i]);
+    if (epoch && epochClock == 0) {
+      epochIndex = i;
+      epochClock = _clocks[i];
+    } else {
+      epoch = false;
+    }
+  }
+  if (!epoch)
+    clocks = _clocks;
+}
+
+VectorClock::~VectorClock() {
+  clock_table_t &table = getClockTable();
+  clock_table_t::iterator it = table.find(this);
+  if (it != table.end() && *it == this)
+    table.erase(it);
+}
+
 ref<VectorClock> VectorClock::create(const uint32_t *buf, const uint32_t nelements) {
   std::vector<clock_counter_t> clocks(buf, buf+nelements);
   return VectorClock::alloc(clocks);
 }
 
-ref<VectorClock> VectorClock::alloc(const std::vector<clock_counter_t> clocks) {
-  ref<VectorClock> r(new VectorClock(clocks));
-  return r;
+ref<VectorClock> VectorClock::alloc(const std::vector<clock_counter_t> &clocks) {
+  // Drop trailing zeros, missing components are zero
+  std::vector<clock_counter_t>::size_type n = clocks.size();
+  while (n > 0 && clocks[n-1] == 0)
+    --n;
+  std::vector<clock_counter_t> trimmed(clocks.begin(), clocks.begin()+n);
+
+  clock_table_t &table = getClockTable();
+  VectorClock key(trimmed);
+  clock_table_t::iterator it = table.find(&key);
+  if (it != table.end())
+    return ref<VectorClock>(*it);
+
+  VectorClock *vc = new VectorClock(trimmed);
+  table.insert(vc);
+  return ref<VectorClock>(vc);
+}
+
+ref<VectorClock> VectorClock::join(const VectorClock &other) const {
+  // Avoid building a new vector when one clock already covers the other
+  if (other.lessOrEqual(*this))
+    return ref<VectorClock>(const_cast<VectorClock*>(this));
+  if (lessOrEqual(other))
+    return ref<VectorClock>(const_cast<VectorClock*>(&other));
+
+  std::vector<clock_counter_t> clocks(std::max(size(), other.size()));
+  for (index_t i = 0, n = clocks.size(); i < n; ++i)
+    clocks[i] = std::max(get(i), other.get(i));
+  return VectorClock::alloc(clocks);
+}
+
+ref<VectorClock> VectorClock::tick(index_t index) const {
+  std::vector<clock_counter_t> clocks(std::max(size(), index+1));
+  for (index_t i = 0, n = size(); i < n; ++i)
+    clocks[i] = get(i);
+  ++clocks[index];
+  return VectorClock::alloc(clocks);
 }
 
 int VectorClock::compare(const VectorClock &other) const {
-  bool allLess = true;
-  bool allEqual = true;
-  clock_iterator_t itA = clocks.begin();
-  clock_iterator_t itB = other.clocks.begin();
-  for (;itA != clocks.end() && itB != other.clocks.end(); ++itA, ++itB) {
-    allLess &= (*itA < *itB);
-    allEqual &= (*itA == *itB);
-  }
+  if (this == &other)
+    return 0;
 
-  if ((allLess) && (clocks.size() <= other.clocks.size()))
+  if (size() < other.size())
     return -1;
-  if ((allEqual) && (clocks.size() == other.clocks.size()))
-    return 0;
-  return 1;
+  if (size() > other.size())
+    return 1;
+
+  for (index_t i = 0, n = size(); i < n; ++i) {
+    clock_counter_t a = get(i), b = other.get(i);
+    if (a < b)
+      return -1;
+    if (a > b)
+      return 1;
+  }
+  return 0;
 }
 
-bool VectorClock::happensBefore(const VectorClock &other) const {
-  bool strictSmallerExists = false;
-  bool allLessOrEqual = true;
+bool VectorClock::lessOrEqual(const VectorClock &other) const {
+  if (epoch)
+    return epochClock <= other.get(epochIndex);
 
-  if (clocks.size() != other.clocks.size())
+  // A full clock has at least two nonzero components, so it cannot be below
+  // an epoch
+  if (other.epoch || clocks.size() > other.clocks.size())
     return false;
 
   clock_iterator_t itA = clocks.begin();
   clock_iterator_t itB = other.clocks.begin();
-  for (;itA != clocks.end() && itB != other.clocks.end(); ++itA, ++itB) {
-    strictSmallerExists |= (*itA < *itB);
-    allLessOrEqual &= (*itA <= *itB);
+  for (;itA != clocks.end(); ++itA, ++itB) {
+    if (*itA > *itB)
+      return false;
   }
-  return (allLessOrEqual && strictSmallerExists);
+  return true;
+}
+
+bool VectorClock::happensBefore(const VectorClock &other) const {
+  // Identical clocks are shared, so different objects differ in at least one
+  // component
+  return this != &other && lessOrEqual(other);
+}
+
+bool VectorClock::happensBefore(const VectorClock &other, index_t index) const {
+  clock_counter_t own = get(index);
+  // The thread has not published its clock yet, so fall back to a full check
+  if (own == 0)
+    return happensBefore(other);
+  return own <= other.get(index) && this != &other;
 }
 
 bool VectorClock::isOrdered(const VectorClock &other) const {
@@ -51,16 +160,14 @@ bool VectorClock::isOrdered(const VectorClock &other) const {
 
 #define ANSI_UNDERLINED_PRE  "\033[4m"
 #define ANSI_UNDERLINED_POST "\033[0m"
-void VectorClock::print(llvm::raw_ostream &os, std::vector<clock_counter_t>::size_type index) const {
+void VectorClock::print(llvm::raw_ostream &os, index_t index) const {
   os << "(";
-  unsigned int i = 0;
-  for (clock_iterator_t it = clocks.begin();
-       it != clocks.end(); ++i) {
+  for (index_t i = 0, n = std::max(size(), index+1); i < n; ++i) {
     if (i==index)
-      os << ANSI_UNDERLINED_PRE << *it << ANSI_UNDERLINED_POST;
+      os << ANSI_UNDERLINED_PRE << get(i) << ANSI_UNDERLINED_POST;
     else
-      os << *it;
-    if (++it!=clocks.end())
+      os << get(i);
+    if (i+1 < n)
       os << ",";
   }
   os << ")";
@@ -68,11 +175,9 @@ void VectorClock::print(llvm::raw_ostream &os, std::vector<clock_counter_t>::siz
 
 void VectorClock::print(llvm::raw_ostream &os) const {
   os << "(";
-  unsigned int i = 0;
-  for (clock_iterator_t it = clocks.begin();
-       it != clocks.end(); ++i) {
-    os << i << ":" << *it;
-    if (++it!=clocks.end())
+  for (index_t i = 0, n = size(); i < n; ++i) {
+    os << i << ":" << get(i);
+    if (i+1 < n)
       os << ",";
   }
   os << ")";
@@ -11,35 +11,86 @@
 
 namespace klee {
 
+/// Immutable, hash-consed vector clock.
+///
+/// Missing components are zero, so clocks are kept without trailing zeros.
+/// Clocks with at most one nonzero component (the common case of a thread
+/// that has not synchronized with others yet) are stored as an epoch c@t
+/// without any vector. Identical clocks share the same object, so equality is
+/// pointer equality.
 class VectorClock {
-private:
+public:
   typedef uint32_t clock_counter_t;
+  typedef std::vector<clock_counter_t>::size_type index_t;
+
+private:
   typedef std::vector<clock_counter_t>::const_iterator
   clock_iterator_t;
-  const std::vector<clock_counter_t> clocks;
 
-  VectorClock(const std::vector<clock_counter_t> _clocks)
-      : clocks(_clocks), refCount(0) {}
+  /// Epoch form: only component epochIndex may be nonzero
+  bool epoch;
+  index_t epochIndex;
+  clock_counter_t epochClock;
+
+  /// Full form: components up to the last nonzero one
+  std::vector<clock_counter_t> clocks;
+
+  unsigned hashValue;
+
+  VectorClock(const std::vector<clock_counter_t> &_clocks);
+
+  bool lessOrEqual(const VectorClock &other) const;
 
 public:
   unsigned refCount;
 
+  ~VectorClock();
+
   static ref<VectorClock> create(const uint32_t *buf, const uint32_t nelements);
   static ref<VectorClock> create() {
     std::vector<clock_counter_t> empty;
     return VectorClock::alloc(empty);
   };
-  static ref<VectorClock> alloc(const std::vector<clock_counter_t> clocks);
+  static ref<VectorClock> alloc(const std::vector<clock_counter_t> &clocks);
+
+  /// Value of component \a index
+  clock_counter_t get(index_t index) const {
+    if (epoch)
+      return index == epochIndex ? epochClock : 0;
+    return index < clocks.size() ? clocks[index] : 0;
+  }
+
+  /// Number of components up to the last nonzero one
+  index_t size() const {
+    if (epoch)
+      return epochClock ? epochIndex + 1 : 0;
+    return clocks.size();
+  }
+
+  bool isEpoch() const { return epoch; }
+
+  /// Component-wise maximum of this clock and \a other
+  ref<VectorClock> join(const VectorClock &other) const;
+
+  /// This clock with component \a index incremented
+  ref<VectorClock> tick(index_t index) const;
+
+  unsigned hash() const { return hashValue; }
 
   int compare(const VectorClock &other) const;
 
   bool happensBefore(const VectorClock &other) const;
 
+  /// Check if an access done by thread \a index with this clock happens
+  /// before an access with clock \a other. The runtime ticks the clock of a
+  /// thread after publishing it, so comparing the epoch of \a index is enough.
+  bool happensBefore(const VectorClock &other, index_t index) const;
+
   bool isOrdered(const VectorClock &other) const;
 
   void print(llvm::raw_ostream &os) const;
 
-  void print(llvm::raw_ostream &os, std::vector<clock_counter_t>::size_type index) const;
+  void print(llvm::raw_ostream &os, index_t index) const;
 };
 
 inline llvm::raw_ostream &operator<<(llvm::raw_ostream &os, const VectorClock &vc) {
@@ -8,6 +8,10 @@
 #include "llvm/ADT/Statistic.h"
 #include "llvm/ADT/StringExtras.h"
 #include "llvm/Analysis/CaptureTracking.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Analysis/ScalarEvolutionExpander.h"
+#include "llvm/Analysis/ScalarEvolutionExpressions.h"
 #include "llvm/Analysis/ValueTracking.h"
 #include "llvm/IR/DataLayout.h"
 #include "llvm/IR/Function.h"
@@ -17,6 +21,7 @@
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Metadata.h"
 #include "llvm/IR/Module.h"
+#include "llvm/IR/Operator.h"
 #include "llvm/IR/Type.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
@@ -25,6 +30,22 @@
 #include "llvm/Transforms/Utils/BasicBlockUtils.h"
 #include "llvm/Transforms/Utils/ModuleUtils.h"
 
+#if LLVM_VERSION_CODE < LLVM_VERSION(3, 5)
+#include "llvm/Analysis/Dominators.h"
+#include "llvm/Support/CallSite.h"
+#include "llvm/Support/CFG.h"
+#include "llvm/Support/InstIterator.h"
+#else
+#include "llvm/IR/CallSite.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/InstIterator.h"
+#endif
+
+#include <algorithm>
+#include <iterator>
+#include <map>
+
 using namespace llvm;
 using namespace klee;
 
@@ -44,6 +65,14 @@ static cl::opt<bool>
 ClInstrumentAll("instrument-all",
                 cl::desc("Enable the options: instrument-atomics, instrument-memory-function and instrument-memory-accesses"),
                 cl::init(false));
+static cl::opt<bool>
+ClPruneAccesses("instrument-prune-accesses",
+                cl::desc("Do not instrument the accesses to globals only used by the main thread, nor check for races the ones always protected by the same mutex (default=on)"),
+                cl::init(true));
+static cl::opt<bool>
+ClCoalesceLoopAccesses("instrument-coalesce-loops",
+                       cl::desc("Report the affine accesses of loops without calls as a single range access after the loop, ignored with --preempt-before-access (default=on)"),
+                       cl::init(true));
 
 char InstrumentAccesses::ID = 0;
 
@@ -64,14 +93,252 @@ bool InstrumentAccesses::doInitialization(Module &M) {
                                                         IntptrTy, IRB.getInt8Ty(),
                                                         IRB.getInt8Ty(), IRB.getInt8Ty(), NULL));
 
+  // void klee_mem_access_range(void * base, size_t size, size_t stride, size_t count, bool isWrite, bool isRaceCandidate)
+  AccessRange = checkInterfaceFunction(M.getOrInsertFunction("klee_mem_access_range",
+                                                             IRB.getVoidTy(), IRB.getInt8PtrTy(),
+                                                             IntptrTy, IntptrTy, IntptrTy,
+                                                             IRB.getInt8Ty(), IRB.getInt8Ty(), NULL));
+
   if (ClInstrumentAll) {
     ClInstrumentMemoryAccesses = true;
     ClInstrumentAtomics = true;
     ClInstrumentMemIntrinsics = true;
   }
+
+  if (ClPruneAccesses)
+    analyzeSharedGlobals(M);
+  return true;
+}
+
+void InstrumentAccesses::getAnalysisUsage(AnalysisUsage &AU) const {
+  AU.addRequired<LoopInfo>();
+  AU.addRequired<ScalarEvolution>();
+#if LLVM_VERSION_CODE < LLVM_VERSION(3, 5)
+  AU.addRequired<DominatorTree>();
+#else
+  AU.addRequired<DominatorTreeWrapperPass>();
+#endif
+}
+
+typedef std::set<Value*> HeldLocks;
+
+// Collect the loads and stores to V. Returns false if its address escapes, so
+// it may be accessed through other pointers.
+static bool collectAccesses(Value *V, SmallVectorImpl<Instruction*> &Accesses) {
+  for (Value::use_iterator UI = V->use_begin(), UE = V->use_end();
+       UI != UE; ++UI) {
+    User *U = *UI;
+    if (LoadInst *LI = dyn_cast<LoadInst>(U)) {
+      Accesses.push_back(LI);
+    } else if (StoreInst *SI = dyn_cast<StoreInst>(U)) {
+      if (SI->getPointerOperand() != V)
+        return false;
+      Accesses.push_back(SI);
+    } else if (isa<GEPOperator>(U) || isa<BitCastOperator>(U)) {
+      if (!collectAccesses(U, Accesses))
+        return false;
+    } else {
+      return false;
+    }
+  }
   return true;
 }
 
+// Functions which may release a mutex before returning
+static void findUnlockingFunctions(Module &M, Function *UnlockFn,
+                                   std::set<Function*> &Unlocking) {
+  bool Changed = true;
+  while (Changed) {
+    Changed = false;
+    for (Module::iterator F = M.begin(), FE = M.end(); F != FE; ++F) {
+      if (F->isDeclaration() || Unlocking.count(&*F))
+        continue;
+      bool MayUnlock = false;
+      for (inst_iterator I = inst_begin(&*F), IE = inst_end(&*F);
+           I != IE && !MayUnlock; ++I) {
+        if (CallInst *CI = dyn_cast<CallInst>(&*I)) {
+          Function *Callee = CI->getCalledFunction();
+          MayUnlock = !Callee || (Callee == UnlockFn && UnlockFn) ||
+                      Unlocking.count(Callee);
+        } else {
+          MayUnlock = isa<InvokeInst>(&*I);
+        }
+      }
+      if (MayUnlock) {
+        Unlocking.insert(&*F);
+        Changed = true;
+      }
+    }
+  }
+}
+
+static void updateHeldLocks(BasicBlock &BB, HeldLocks &Held,
+                            Function *LockFn, Function *UnlockFn,
+                            const std::set<Function*> &Unlocking,
+                            std::map<const Instruction*, HeldLocks> *Result) {
+  for (BasicBlock::iterator I = BB.begin(), IE = BB.end(); I != IE; ++I) {
+    if (CallInst *CI = dyn_cast<CallInst>(&*I)) {
+      Function *Callee = CI->getCalledFunction();
+      Value *Lock = CI->getNumArgOperands() ?
+                    CI->getArgOperand(0)->stripPointerCasts() : 0;
+      if (Callee && Callee == LockFn) {
+        // Only mutexes with a constant address are the same in every thread
+        if (isa<Constant>(Lock))
+          Held.insert(Lock);
+      } else if (Callee && Callee == UnlockFn) {
+        Held.erase(Lock);
+      } else if (!Callee || Unlocking.count(Callee)) {
+        Held.clear();
+      }
+    } else if (isa<InvokeInst>(&*I)) {
+      Held.clear();
+    } else if (Result && (isa<LoadInst>(&*I) || isa<StoreInst>(&*I))) {
+      (*Result)[&*I] = Held;
+    }
+  }
+}
+
+// Mutexes held at every load and store of F, whatever the path followed
+static void computeHeldLocks(Function &F, Function *LockFn, Function *UnlockFn,
+                             const std::set<Function*> &Unlocking,
+                             std::map<const Instruction*, HeldLocks> &Result) {
+  // Blocks not reached yet hold every mutex, so the sets only shrink
+  std::map<BasicBlock*, HeldLocks> Out;
+  bool Changed = true;
+  while (Changed) {
+    Changed = false;
+    for (Function::iterator BI = F.begin(), BE = F.end(); BI != BE; ++BI) {
+      BasicBlock *BB = &*BI;
+      HeldLocks Held;
+      bool Reached = (BB == &F.getEntryBlock());
+      for (pred_iterator PI = pred_begin(BB), PE = pred_end(BB); PI != PE; ++PI) {
+        std::map<BasicBlock*, HeldLocks>::iterator It = Out.find(*PI);
+        if (It == Out.end())
+          continue;
+        if (!Reached) {
+          Held = It->second;
+          Reached = true;
+        } else {
+          HeldLocks Common;
+          std::set_intersection(Held.begin(), Held.end(),
+                                It->second.begin(), It->second.end(),
+                                std::inserter(Common, Common.begin()));
+          Held.swap(Common);
+        }
+      }
+      if (!Reached)
+        continue;
+
+      updateHeldLocks(*BB, Held, LockFn, UnlockFn, Unlocking, 0);
+      std::map<BasicBlock*, HeldLocks>::iterator It = Out.find(BB);
+      if (It == Out.end() || It->second != Held) {
+        Out[BB] = Held;
+        Changed = true;
+      }
+    }
+  }
+
+  // Record the mutexes held at each access of the reached blocks
+  for (Function::iterator BI = F.begin(), BE = F.end(); BI != BE; ++BI) {
+    BasicBlock *BB = &*BI;
+    HeldLocks Held;
+    bool Reached = (BB == &F.getEntryBlock());
+    for (pred_iterator PI = pred_begin(BB), PE = pred_end(BB); PI != PE; ++PI) {
+      std::map<BasicBlock*, HeldLocks>::iterator It = Out.find(*PI);
+      if (It == Out.end())
+        continue;
+      if (!Reached) {
+        Held = It->second;
+        Reached = true;
+      } else {
+        HeldLocks Common;
+        std::set_intersection(Held.begin(), Held.end(),
+                              It->second.begin(), It->second.end(),
+                              std::inserter(Common, Common.begin()));
+        Held.swap(Common);
+      }
+    }
+    if (Reached)
+      updateHeldLocks(*BB, Held, LockFn, UnlockFn, Unlocking, &Result);
+  }
+}
+
+// Find the globals which cannot be accessed concurrently:
+//  - globals only accessed from code run by the main thread. Any function
+//    whose address is taken may be a thread start routine, so only the
+//    functions not reachable from them through direct calls or invokes are
+//    main-only.
+//  - globals always accessed holding the same mutex, according to an
+//    intraprocedural must-hold analysis of pthread_mutex_lock/unlock.
+// In both cases the address of the global must not escape.
+void InstrumentAccesses::analyzeSharedGlobals(Module &M) {
+  std::set<Function*> ThreadCode;
+  SmallVector<Function*, 16> Worklist;
+  for (Module::iterator F = M.begin(), FE = M.end(); F != FE; ++F) {
+    if (F->hasAddressTaken() && ThreadCode.insert(&*F).second)
+      Worklist.push_back(&*F);
+  }
+  while (!Worklist.empty()) {
+    Function *F = Worklist.pop_back_val();
+    for (inst_iterator I = inst_begin(F), IE = inst_end(F); I != IE; ++I) {
+      CallSite CS(&*I);
+      if (!CS)
+        continue;
+      Function *Callee = CS.getCalledFunction();
+      if (Callee && !Callee->isDeclaration() && ThreadCode.insert(Callee).second)
+        Worklist.push_back(Callee);
+    }
+  }
+
+  Function *LockFn = M.getFunction("pthread_mutex_lock");
+  Function *UnlockFn = M.getFunction("pthread_mutex_unlock");
+  std::set<Function*> Unlocking;
+  findUnlockingFunctions(M, UnlockFn, Unlocking);
+  std::map<Function*, std::map<const Instruction*, HeldLocks> > HeldAt;
+
+  for (Module::global_iterator G = M.global_begin(), GE = M.global_end();
+       G != GE; ++G) {
+    if (G->isDeclaration() || G->isConstant())
+      continue;
+
+    SmallVector<Instruction*, 16> Accesses;
+    if (!collectAccesses(&*G, Accesses) || Accesses.empty())
+      continue;
+
+    bool MainOnly = true;
+    for (unsigned i = 0; i < Accesses.size() && MainOnly; ++i)
+      MainOnly = !ThreadCode.count(Accesses[i]->getParent()->getParent());
+    if (MainOnly) {
+      ThreadLocalGlobals.insert(&*G);
+      continue;
+    }
+
+    if (!LockFn)
+      continue;
+
+    HeldLocks Common;
+    for (unsigned i = 0; i < Accesses.size(); ++i) {
+      Function *F = Accesses[i]->getParent()->getParent();
+      if (!HeldAt.count(F))
+        computeHeldLocks(*F, LockFn, UnlockFn, Unlocking, HeldAt[F]);
+      const HeldLocks &Held = HeldAt[F][Accesses[i]];
+      if (i == 0) {
+        Common = Held;
+      } else {
+        HeldLocks Both;
+        std::set_intersection(Common.begin(), Common.end(),
+                              Held.begin(), Held.end(),
+                              std::inserter(Both, Both.begin()));
+        Common.swap(Both);
+      }
+      if (Common.empty())
+        break;
+    }
+    if (!Common.empty())
+      LockProtectedGlobals.insert(&*G);
+  }
+}
+
 static bool isVtableAccess(Instruction *I) {
   if (MDNode *Tag = I->getMetadata(LLVMContext::MD_tbaa))
     return Tag->isTBAAVtableAccess();
@@ -134,6 +401,9 @@ void InstrumentAccesses::chooseInstructionsToInstrument(
       // referenced from a different thread and participate in a data race
       // (see llvm/Analysis/CaptureTracking.h for details).
       continue;
+    if (ThreadLocalGlobals.count(GetUnderlyingObject(Addr, &DL)))
+      // The global is only accessed by the main thread.
+      continue;
 
     All.push_back(I);
   }
@@ -162,6 +432,15 @@ bool InstrumentAccesses::runOnFunction(Function &F) {
   SmallVector<Instruction*, 8> MemIntrinCalls;
   bool Res = false;
 
+  LI = &getAnalysis<LoopInfo>();
+  SE = &getAnalysis<ScalarEvolution>();
+#if LLVM_VERSION_CODE < LLVM_VERSION(3, 5)
+  DT = &getAnalysis<DominatorTree>();
+#else
+  DT = &getAnalysis<DominatorTreeWrapperPass>().getDomTree();
+#endif
+  CallFreeLoops.clear();
+
   // Traverse all instructions, collect loads/stores/returns, check for calls.
   for (Function::iterator FI = F.begin(), FE = F.end();
        FI != FE; ++FI) {
@@ -190,9 +469,21 @@ bool InstrumentAccesses::runOnFunction(Function &F) {
   // (e.g. variables that do not escape, etc).
 
   // Instrument memory accesses only if we want to report bugs in the function.
-  if (ClInstrumentMemoryAccesses)
-    for (size_t i = 0, n = AllLoadsAndStores.size(); i < n; ++i)
-      Res |= instrumentLoadOrStore(AllLoadsAndStores[i], DL);
+  // The loops are analyzed before adding any call to them.
+  if (ClInstrumentMemoryAccesses) {
+    SmallVector<Instruction*, 8> LoopAccesses;
+    SmallVector<Instruction*, 8> OtherAccesses;
+    for (size_t i = 0, n = AllLoadsAndStores.size(); i < n; ++i) {
+      if (canCoalesceLoopAccess(AllLoadsAndStores[i]))
+        LoopAccesses.push_back(AllLoadsAndStores[i]);
+      else
+        OtherAccesses.push_back(AllLoadsAndStores[i]);
+    }
+    for (size_t i = 0, n = OtherAccesses.size(); i < n; ++i)
+      Res |= instrumentLoadOrStore(OtherAccesses[i], DL);
+    for (size_t i = 0, n = LoopAccesses.size(); i < n; ++i)
+      Res |= instrumentLoopAccess(LoopAccesses[i], DL);
+  }
 
   // Instrument atomic memory accesses in any case (they can be used to
   // implement synchronization).
@@ -221,15 +512,114 @@ bool InstrumentAccesses::instrumentLoadOrStore(Instruction *I,
   if (isVtableAccess(I))
     llvm::errs() << "Unsupported virtual tables instrumentation\n";
 
+  // Accesses protected by the same mutex are ordered by it
+  bool IsRaceCandidate = !LockProtectedGlobals.count(GetUnderlyingObject(Addr, &DL));
+
   IRB.CreateCall5(Access, IRB.CreatePointerCast(Addr, IRB.getInt8PtrTy()),
                   ConstantInt::get(IntptrTy, Idx),//size
                   ConstantInt::get(IRB.getInt8Ty(), IsWrite?1:0),//is write?
                   ConstantInt::get(IRB.getInt8Ty(), 0), //not atomic
-                  ConstantInt::get(IRB.getInt8Ty(), 1), //is race candidate
+                  ConstantInt::get(IRB.getInt8Ty(), IsRaceCandidate?1:0), //is race candidate
                  "");
   return true;
 }
 
+bool InstrumentAccesses::loopHasCalls(Loop *L) {
+  std::map<const Loop*, bool>::iterator It = CallFreeLoops.find(L);
+  if (It != CallFreeLoops.end())
+    return !It->second;
+
+  bool HasCalls = false;
+  for (Loop::block_iterator BI = L->block_begin(), BE = L->block_end();
+       BI != BE && !HasCalls; ++BI) {
+    for (BasicBlock::iterator I = (*BI)->begin(), IE = (*BI)->end();
+         I != IE && !HasCalls; ++I)
+      HasCalls = (isa<CallInst>(&*I) && !isa<DbgInfoIntrinsic>(&*I)) ||
+                 isa<InvokeInst>(&*I);
+  }
+  CallFreeLoops[L] = !HasCalls;
+  return HasCalls;
+}
+
+// No thread can be scheduled while a loop without calls runs, so its accesses
+// may be reported at once when it exits. The access must be done at an
+// affine address with a constant stride, the same number of times as the
+// loop condition is checked (or once less), and the loop must have a single
+// exit reached from a single block.
+bool InstrumentAccesses::canCoalesceLoopAccess(Instruction *I) {
+  if (!ClCoalesceLoopAccesses || !coalesceLoops || isVtableAccess(I))
+    return false;
+
+  BasicBlock *BB = I->getParent();
+  Loop *L = LI->getLoopFor(BB);
+  if (!L)
+    return false;
+
+  BasicBlock *Exiting = L->getExitingBlock();
+  BasicBlock *Exit = L->getExitBlock();
+  BasicBlock *Latch = L->getLoopLatch();
+  if (!L->getLoopPreheader() || !Exiting || !Exit || !Latch ||
+      Exit->getSinglePredecessor() != Exiting || loopHasCalls(L))
+    return false;
+
+  Value *Addr = isa<StoreInst>(*I)
+      ? cast<StoreInst>(I)->getPointerOperand()
+      : cast<LoadInst>(I)->getPointerOperand();
+  const SCEVAddRecExpr *AR = dyn_cast<SCEVAddRecExpr>(SE->getSCEV(Addr));
+  if (!AR || AR->getLoop() != L || !AR->isAffine() ||
+      !isa<SCEVConstant>(AR->getStepRecurrence(*SE)))
+    return false;
+
+  const SCEV *Taken = SE->getBackedgeTakenCount(L);
+  if (isa<SCEVCouldNotCompute>(Taken) || !SE->isLoopInvariant(Taken, L))
+    return false;
+
+  return DT->dominates(BB, Exiting) ||
+         (DT->dominates(Exiting, BB) && DT->dominates(BB, Latch));
+}
+
+bool InstrumentAccesses::instrumentLoopAccess(Instruction *I,
+                                              const DataLayout &DL) {
+  BasicBlock *BB = I->getParent();
+  Loop *L = LI->getLoopFor(BB);
+  BasicBlock *Exiting = L->getExitingBlock();
+  bool IsWrite = isa<StoreInst>(*I);
+  Value *Addr = IsWrite
+      ? cast<StoreInst>(I)->getPointerOperand()
+      : cast<LoadInst>(I)->getPointerOperand();
+  const SCEVAddRecExpr *AR = cast<SCEVAddRecExpr>(SE->getSCEV(Addr));
+  const SCEVConstant *Step = cast<SCEVConstant>(AR->getStepRecurrence(*SE));
+  Type *OrigTy = cast<PointerType>(Addr->getType())->getElementType();
+  uint64_t Size = DL.getTypeStoreSize(OrigTy);
+
+  // Accesses before the exit check run once more than the back edge
+  const SCEV *Count = SE->getTruncateOrZeroExtend(SE->getBackedgeTakenCount(L),
+                                                  IntptrTy);
+  if (DT->dominates(BB, Exiting))
+    Count = SE->getAddExpr(Count, SE->getConstant(IntptrTy, 1));
+
+  SCEVExpander Expander(*SE, "klee.range");
+  Instruction *Preheader = L->getLoopPreheader()->getTerminator();
+  Value *Base = Expander.expandCodeFor(AR->getStart(), Addr->getType(), Preheader);
+  Value *N = Expander.expandCodeFor(Count, IntptrTy, Preheader);
+
+  // Accesses protected by the same mutex are ordered by it
+  bool IsRaceCandidate = !LockProtectedGlobals.count(GetUnderlyingObject(Addr, &DL));
+
+  IRBuilder<> IRB(&*L->getExitBlock()->getFirstInsertionPt());
+  IRB.SetCurrentDebugLocation(I->getDebugLoc());
+  Value *Args[] = {
+    IRB.CreatePointerCast(Base, IRB.getInt8PtrTy()),
+    ConstantInt::get(IntptrTy, Size),//size
+    ConstantInt::get(IntptrTy, Step->getValue()->getSExtValue(), true),//stride
+    N,//count
+    ConstantInt::get(IRB.getInt8Ty(), IsWrite?1:0),//is write?
+    ConstantInt::get(IRB.getInt8Ty(), IsRaceCandidate?1:0)//is race candidate
+  };
+  IRB.CreateCall(AccessRange, Args);
+  return true;
+}
+
 bool InstrumentAccesses::instrumentMemIntrinsic(Instruction *I) {
   IRBuilder<> IRB(I);
   if (MemSetInst *M = dyn_cast<MemSetInst>(I)) {
@@ -317,6 +707,6 @@ int InstrumentAccesses::getMemoryAccessWidth(Value *Addr,
   Type *OrigPtrTy = Addr->getType();
   Type *OrigTy = cast<PointerType>(OrigPtrTy)->getElementType();
   assert(OrigTy->isSized());
-  uint32_t TypeSize = DL.getTypeStoreSizeInBits(OrigTy);
-  return countTrailingZeros(TypeSize / 8);
+  // The size in bytes, as klee_mem_access_range reports it
+  return DL.getTypeStoreSize(OrigTy);
 }
@@ -111,6 +111,7 @@ KModule::KModule(Module *_module)
     targetData(new DataLayout(module)),
 #endif
     kleeMergeFn(0),
+    kleeMemAccessFn(0),
     infos(0),
     constantTable(0) {
 }
@@ -434,6 +435,7 @@ void KModule::prepare(const Interpreter::ModuleOptions &opts,
   }
 
   kleeMergeFn = module->getFunction("klee_merge");
+  kleeMemAccessFn = module->getFunction("klee_mem_access");
 
   /* Build shadow structures */
 
@@ -521,6 +523,20 @@ static int getOperandNum(Value *v,
   }
 }
 
+static KInstruction *createMemAccessInstruction(CallInst *ci) {
+  KMemAccessInstruction *kmi = new KMemAccessInstruction();
+  kmi->decoded = ci->getNumArgOperands() == 5;
+  for (unsigned j = 1; j < ci->getNumArgOperands() && kmi->decoded; ++j)
+    kmi->decoded = isa<ConstantInt>(ci->getArgOperand(j));
+  if (kmi->decoded) {
+    kmi->bytes = cast<ConstantInt>(ci->getArgOperand(1))->getZExtValue();
+    kmi->isWrite = !cast<ConstantInt>(ci->getArgOperand(2))->isZero();
+    kmi->isAtomic = !cast<ConstantInt>(ci->getArgOperand(3))->isZero();
+    kmi->isRaceCandidate = !cast<ConstantInt>(ci->getArgOperand(4))->isZero();
+  }
+  return kmi;
+}
+
 KFunction::KFunction(llvm::Function *_function,
                      KModule *km) 
   : function(_function),
@@ -560,6 +576,13 @@ KFunction::KFunction(llvm::Function *_function,
       case Instruction::InsertValue:
       case Instruction::ExtractValue:
         ki = new KGEPInstruction(); break;
+      case Instruction::Call:
+        if (km->kleeMemAccessFn &&
+            cast<CallInst>(it)->getCalledValue() == km->kleeMemAccessFn) {
+          ki = createMemAccessInstruction(cast<CallInst>(it));
+          break;
+        }
+        ki = new KInstruction(); break;
       default:
         ki = new KInstruction(); break;
       }
@@ -24,6 +24,9 @@
 #include "llvm/Pass.h"
 #include "llvm/CodeGen/IntrinsicLowering.h"
 
+#include <map>
+#include <set>
+
 namespace llvm {
   class Function;
   class Instruction;
@@ -33,6 +36,10 @@ namespace llvm {
 #else
   class DataLayout;
 #endif
+  class DominatorTree;
+  class Loop;
+  class LoopInfo;
+  class ScalarEvolution;
   class TargetLowering;
   class Type;
 }
@@ -186,26 +193,45 @@ public:
   virtual bool runOnModule(llvm::Module &M);
   bool doInitialization(llvm::Module &M);
 
+  /// Whether preemption points are added before memory accesses
+  /// (-preempt-before-access)
+  static bool preemptsBeforeAccesses();
+
 private:
   llvm::SmallVector<std::pair<llvm::Function *, llvm::ConstantInt *>, 16> pthreadFunctions;
   llvm::Function *preemptFunction;
+  /// klee_mem_access, added by InstrumentAccesses
+  llvm::Function *accessFunction;
 
-  bool addPreemptionBefore(llvm::Instruction *I);
+  bool addPreemptionBefore(llvm::Instruction *I, const char *kind = "pthread");
   bool addPreemptionAfter(llvm::Instruction *I);
   bool addPreemptionAfterIfSuccess(llvm::CallInst *inst, llvm::ConstantInt *ret);
+
+  /// Add a preemption point before \a I while the per-path \a budget
+  /// counter is not exhausted. A null budget is unlimited.
+  bool addBudgetedPreemptionBefore(llvm::Instruction *I, const char *kind,
+                                   llvm::GlobalVariable *budget);
+
+  /// Add the preemption points before the instrumented memory accesses
+  bool addAccessPreemptions(llvm::Module &M);
 };
 
 /// InstrumentAccesses: instrument the code in module to find races.
 class InstrumentAccesses : public llvm::FunctionPass {
 public:
   static char ID;  // Pass identification, replacement for typeid.
-  InstrumentAccesses(const llvm::DataLayout &_DL) : FunctionPass(ID),DL(_DL) {}
+  InstrumentAccesses(const llvm::DataLayout &_DL, bool _coalesceLoops = true)
+    : FunctionPass(ID), DL(_DL), coalesceLoops(_coalesceLoops) {}
 
   bool runOnFunction(llvm::Function &F);
   bool doInitialization(llvm::Module &M);
+  void getAnalysisUsage(llvm::AnalysisUsage &AU) const;
 
 private:
   bool instrumentLoadOrStore(llvm::Instruction *I, const llvm::DataLayout &DL);
+  bool canCoalesceLoopAccess(llvm::Instruction *I);
+  bool instrumentLoopAccess(llvm::Instruction *I, const llvm::DataLayout &DL);
+  bool loopHasCalls(llvm::Loop *L);
   bool instrumentAtomic(llvm::Instruction *I, const llvm::DataLayout &DL);
   bool instrumentMemIntrinsic(llvm::Instruction *I);
   void chooseInstructionsToInstrument(llvm::SmallVectorImpl<llvm::Instruction *> &Local,
@@ -213,11 +239,25 @@ private:
                                       const llvm::DataLayout &DL);
   bool addrPointsToConstantData(llvm::Value *Addr);
   int getMemoryAccessWidth(llvm::Value *Addr, const llvm::DataLayout &DL);
+  void analyzeSharedGlobals(llvm::Module &M);
 
   const llvm::DataLayout &DL;
+  /// Coalesce the loop accesses unless disabled (-instrument-coalesce-loops)
+  bool coalesceLoops;
   llvm::Type *IntptrTy;
   // Callbacks to run-time library are computed in doInitialization.
   llvm::Function *Access;
+  llvm::Function *AccessRange;
+  // Analyses of the function being instrumented, set in runOnFunction.
+  llvm::LoopInfo *LI;
+  llvm::ScalarEvolution *SE;
+  llvm::DominatorTree *DT;
+  // Loops known to run without calls, so no thread can be scheduled in them.
+  std::map<const llvm::Loop *, bool> CallFreeLoops;
+  // Globals only accessed by the main thread, computed in doInitialization.
+  std::set<const llvm::Value *> ThreadLocalGlobals;
+  // Globals always accessed holding the same mutex, computed in doInitialization.
+  std::set<const llvm::Value *> LockProtectedGlobals;
 };
 
 }
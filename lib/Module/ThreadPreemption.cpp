@@ -35,6 +35,37 @@ ClPreemptAfterIfSuccess("preempt-after-pthread-success",
         cl::desc("Add preemption points after pthread calls, if the call is succesful (default=off)"),
         cl::init(false));
 
+enum PreemptAccessMode {
+  PreemptNoAccess,
+  PreemptSharedAccess,
+  PreemptFirstAccessInBlock
+};
+
+static cl::opt<PreemptAccessMode>
+ClPreemptAccesses("preempt-before-access",
+        cl::desc("Add preemption points before the memory accesses instrumented as race candidates (default=none)"),
+        cl::values(clEnumValN(PreemptNoAccess, "none", "No preemption points at accesses"),
+                   clEnumValN(PreemptSharedAccess, "shared", "Before every race candidate access"),
+                   clEnumValN(PreemptFirstAccessInBlock, "first-in-block",
+                              "Before the first race candidate access of each basic block"),
+                   clEnumValEnd),
+        cl::init(PreemptNoAccess));
+
+static cl::opt<unsigned>
+ClPreemptAccessBudget("preempt-access-budget",
+        cl::desc("Maximum number of access preemption points taken along a path, 0 for no limit (default=0)"),
+        cl::init(0));
+
+static cl::opt<bool>
+ClPreemptBeforeAtomic("preempt-before-atomic",
+        cl::desc("Add preemption points before the instrumented atomic accesses (default=off)"),
+        cl::init(false));
+
+static cl::opt<unsigned>
+ClPreemptAtomicBudget("preempt-atomic-budget",
+        cl::desc("Maximum number of atomic preemption points taken along a path, 0 for no limit (default=0)"),
+        cl::init(0));
+
 char ThreadPreemptionPass::ID = 0;
 
 static Function *checkInterfaceFunction(Constant *FuncOrBitcast) {
@@ -62,6 +93,10 @@ static const char * pthreadFuncNames[nPthreadNames] = {
   "sem_post"
 };
 
+bool ThreadPreemptionPass::preemptsBeforeAccesses() {
+  return ClPreemptAccesses != PreemptNoAccess;
+}
+
 bool ThreadPreemptionPass::doInitialization(Module &M) {
   IRBuilder<> IRB(M.getContext());
   // void klee_thread_preempt(int yield)
@@ -76,6 +111,8 @@ bool ThreadPreemptionPass::doInitialization(Module &M) {
   if (Function* f = M.getFunction("pthread_barrier_wait"))
     pthreadFunctions.push_back(std::make_pair(f, ConstantInt::get(IRB.getInt32Ty(),
                                                                   PTHREAD_BARRIER_SERIAL_THREAD)));
+
+  accessFunction = M.getFunction("klee_mem_access");
   return true;
 }
 
@@ -111,15 +148,96 @@ bool ThreadPreemptionPass::runOnModule(Module &M) {
     }
   }
 
+  changed |= addAccessPreemptions(M);
+
   return changed;
 }
 
-bool ThreadPreemptionPass::addPreemptionBefore(Instruction *I) {
+// The kind of the point is kept as metadata, so the executor can account the
+// states forked at each kind of point
+bool ThreadPreemptionPass::addPreemptionBefore(Instruction *I, const char *kind) {
   IRBuilder<> IRB(I);
-  IRB.CreateCall(preemptFunction, ConstantInt::get(IRB.getInt32Ty(), 0), "");
+  CallInst *call = IRB.CreateCall(preemptFunction, ConstantInt::get(IRB.getInt32Ty(), 0), "");
+  LLVMContext &ctx = I->getContext();
+  call->setMetadata("klee.preempt", MDNode::get(ctx, MDString::get(ctx, kind)));
   return true;
 }
 
+bool ThreadPreemptionPass::addBudgetedPreemptionBefore(Instruction *I, const char *kind,
+                                                       GlobalVariable *budget) {
+  if (!budget)
+    return addPreemptionBefore(I, kind);
+
+  // The budget is a global of the program, so each path spends its own
+  IRBuilder<> IRB(I);
+  Value *left = IRB.CreateLoad(budget, "_preemptbudget");
+  Value *cmp = IRB.CreateICmpNE(left, ConstantInt::get(left->getType(), 0),
+                                "_preemptcmp");
+  TerminatorInst *term = SplitBlockAndInsertIfThen(cast<Instruction>(cmp), false, NULL);
+  IRB.SetInsertPoint(term);
+  IRB.CreateStore(IRB.CreateSub(left, ConstantInt::get(left->getType(), 1)), budget);
+  return addPreemptionBefore(term, kind);
+}
+
+static GlobalVariable *createBudget(Module &M, unsigned budget, const char *name) {
+  if (!budget)
+    return 0;
+  Type *ty = Type::getInt32Ty(M.getContext());
+  return new GlobalVariable(M, ty, false, GlobalValue::InternalLinkage,
+                            ConstantInt::get(ty, budget), name);
+}
+
+bool ThreadPreemptionPass::addAccessPreemptions(Module &M) {
+  if (!accessFunction ||
+      (ClPreemptAccesses == PreemptNoAccess && !ClPreemptBeforeAtomic))
+    return false;
+
+  // Collect the calls first, as adding budgeted points splits the blocks
+  SmallVector<Instruction*, 32> accessPoints;
+  SmallVector<Instruction*, 32> atomicPoints;
+  for (Module::iterator F = M.begin(), FE = M.end(); F != FE; ++F) {
+    for (Function::iterator BB = F->begin(), BBE = F->end(); BB != BBE; ++BB) {
+      bool seenAccess = false;
+      for (BasicBlock::iterator I = BB->begin(), IE = BB->end(); I != IE; ++I) {
+        CallInst *call = dyn_cast<CallInst>(&*I);
+        if (!call || call->getCalledFunction() != accessFunction)
+          continue;
+
+        // void klee_mem_access(void * address, size_t size, bool isWrite, bool isAtomic, bool isRaceCandidate)
+        ConstantInt *isAtomic = dyn_cast<ConstantInt>(call->getArgOperand(3));
+        ConstantInt *isRaceCandidate = dyn_cast<ConstantInt>(call->getArgOperand(4));
+        if (!isAtomic || !isRaceCandidate)
+          continue;
+
+        if (!isAtomic->isZero()) {
+          if (ClPreemptBeforeAtomic)
+            atomicPoints.push_back(call);
+        } else if (!isRaceCandidate->isZero()) {
+          if (ClPreemptAccesses == PreemptSharedAccess ||
+              (ClPreemptAccesses == PreemptFirstAccessInBlock && !seenAccess))
+            accessPoints.push_back(call);
+          seenAccess = true;
+        }
+      }
+    }
+  }
+
+  bool changed = false;
+  GlobalVariable *accessBudget = accessPoints.empty() ? 0 :
+      createBudget(M, ClPreemptAccessBudget, "klee.preempt.access.budget");
+  for (SmallVectorImpl<Instruction*>::iterator it = accessPoints.begin(),
+       ite = accessPoints.end(); it != ite; ++it)
+    changed |= addBudgetedPreemptionBefore(*it, "access", accessBudget);
+
+  GlobalVariable *atomicBudget = atomicPoints.empty() ? 0 :
+      createBudget(M, ClPreemptAtomicBudget, "klee.preempt.atomic.budget");
+  for (SmallVectorImpl<Instruction*>::iterator it = atomicPoints.begin(),
+       ite = atomicPoints.end(); it != ite; ++it)
+    changed |= addBudgetedPreemptionBefore(*it, "atomic", atomicBudget);
+
+  return changed;
+}
+
 bool ThreadPreemptionPass::addPreemptionAfter(Instruction *I) {
   IRBuilder<> IRB(I->getNextNode());
   IRB.CreateCall(preemptFunction, ConstantInt::get(IRB.getInt32Ty(), 0), "");
@@ -87,7 +87,7 @@ int sem_init(sem_posix_t *sem, int pshared, unsigned int value) {
   sdata->wlist = klee_get_wlist();
   sdata->count = value;
 
-  __vclock_clear(sdata->vc);
+  __vclock_clear(sdata);
 
   return 0;
 }
@@ -109,12 +109,13 @@ static int _atomic_sem_lock(sem_data_t *sdata, char try) {
       return -1;
     } else {
       __thread_sleep(sdata->wlist);
-      __vclock_update_current(sdata->vc);
-      __vclock_tock_current();
-      __vclock_send_current();
     }
   }
 
+  // Taking a unit orders the thread after the posts, whether it waited or
+  // not. It also marks the transition as dependent for the sleep sets.
+  __vclock_acquire(sdata);
+
   return 0;
 }
 
@@ -133,12 +134,12 @@ int sem_trywait(sem_posix_t *sem) {
 static int _atomic_sem_unlock(sem_data_t *sdata) {
   sdata->count++;
 
-  if (sdata->count <= 0) {
+  // The unit may be taken later by a thread that does not wait, so every
+  // post publishes its clock
+  __vclock_release_merge(sdata);
+
+  if (sdata->count <= 0)
     __thread_notify_one(sdata->wlist);
-    __vclock_copy(sdata->vc,__tsync.threads[pthread_self()].vc);
-    __vclock_tock_current();
-    __vclock_send_current();
-  }
 
   return 0;
 }
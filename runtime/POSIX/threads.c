@@ -72,50 +72,45 @@ pthread_t pthread_self(void) {
 
 int pthread_create(pthread_t *thread, const pthread_attr_t *attr,
     void *(*start_routine)(void*), void *arg) {
-  unsigned int newIdx = MAX_THREADS;
-  unsigned int i;
-  for (i = 0; i < MAX_THREADS; i++) {
-    if (!__tsync.threads[i].allocated) {
-      __tsync.threads[i].allocated = 1;
-      newIdx = i;
+  unsigned int newIdx;
+  for (newIdx = 0; newIdx < __tsync.size; newIdx++) {
+    thread_data_t *slot = __tsync.threads[newIdx];
+    if (!slot || !slot->allocated)
       break;
-    }
   }
 
-  if (newIdx == MAX_THREADS) {
+  thread_data_t *tdata = __alloc_thread_data(newIdx);
+  if (!tdata) {
     errno = EAGAIN;
     return -1;
   }
 
-  thread_data_t *tdata = &__tsync.threads[newIdx];
+  tdata->allocated = 1;
   tdata->terminated = 0;
   tdata->joinable = 1; // TODO: Read this from an attribute
   tdata->wlist = klee_get_wlist();
+  __vclock_clear(tdata);
 
   klee_thread_create(newIdx, start_routine, arg);
   *thread = newIdx;
 
-  __vclock_tock_current();
-  __vclock_copy(tdata->vc, __tsync.threads[pthread_self()].vc);
-  __vclock_tock_current();
-  __vclock_tock(newIdx);
-  __vclock_send_current();
-  __vclock_send(newIdx);
+  __vclock_fork(newIdx);
 
   return 0;
 }
 
 void pthread_exit(void *value_ptr) {
   unsigned int idx = pthread_self();
-  thread_data_t *tdata = &__tsync.threads[idx];
+  thread_data_t *tdata = __get_thread_data(idx);
 
   if (tdata->joinable) {
     tdata->terminated = 1;
     tdata->ret_value = value_ptr;
 
+    __vclock_release(tdata);
     __thread_notify_all(tdata->wlist);
   } else {
-    memset(&__tsync.threads[idx], 0, sizeof(__tsync.threads[idx]));
+    memset(tdata, 0, sizeof(*tdata));
   }
 
   klee_thread_terminate(); // Does not return
@@ -123,7 +118,9 @@ void pthread_exit(void *value_ptr) {
 
 
 int pthread_join(pthread_t thread, void **value_ptr) {
-  if (thread >= MAX_THREADS) {
+  thread_data_t *tdata = __get_thread_data(thread);
+
+  if (!tdata) {
     errno = ESRCH;
     return -1;
   }
@@ -133,8 +130,6 @@ int pthread_join(pthread_t thread, void **value_ptr) {
     return -1;
   }
 
-  thread_data_t *tdata = &__tsync.threads[thread];
-
   if (!tdata->allocated) {
     errno = ESRCH;
     return -1;
@@ -148,27 +143,21 @@ int pthread_join(pthread_t thread, void **value_ptr) {
   if (!tdata->terminated)
     __thread_sleep(tdata->wlist);
 
-  __vclock_update_current(tdata->vc);
-  __vclock_tock_current();
-  __vclock_send_current();
+  __vclock_acquire(tdata);
 
   if (value_ptr) {
     *value_ptr = tdata->ret_value;
   }
 
-  memset(&__tsync.threads[thread], 0, sizeof(__tsync.threads[thread]));
+  memset(tdata, 0, sizeof(*tdata));
 
   return 0;
 }
 
 int pthread_detach(pthread_t thread) {
-  if (thread >= MAX_THREADS) {
-    errno = ESRCH;
-  }
-
-  thread_data_t *tdata = &__tsync.threads[thread];
+  thread_data_t *tdata = __get_thread_data(thread);
 
-  if (!tdata->allocated) {
+  if (!tdata || !tdata->allocated) {
     errno = ESRCH;
     return -1;
   }
@@ -179,7 +168,7 @@ int pthread_detach(pthread_t thread) {
   }
 
   if (tdata->terminated) {
-    memset(&__tsync.threads[thread], 0, sizeof(__tsync.threads[thread]));
+    memset(tdata, 0, sizeof(*tdata));
   } else {
     tdata->joinable = 0;
   }
@@ -261,7 +250,7 @@ static void _mutex_init(pthread_mutex_t *mutex, const pthread_mutexattr_t *attr)
   else
     mdata->count = -1;
 
-  __vclock_clear(mdata->vc);
+  __vclock_clear(mdata);
 }
 
 static mutex_data_t *_get_mutex_data(pthread_mutex_t *mutex) {
@@ -311,9 +300,7 @@ static int _atomic_mutex_lock(mutex_data_t *mdata, char try) {
     mdata->count = 1;
 
   if (!disable_vc_mutex) {
-    __vclock_update_current(mdata->vc);
-    __vclock_tock_current();
-    __vclock_send_current();
+    __vclock_acquire(mdata);
   }
   __lockset_acquire(mdata, mdata->owner);
 
@@ -346,9 +333,7 @@ static int _atomic_mutex_unlock(mutex_data_t *mdata) {
   mdata->taken = 0;
 
   if (!disable_vc_mutex) {
-    __vclock_copy(mdata->vc,__tsync.threads[pthread_self()].vc);
-    __vclock_tock_current();
-    __vclock_send_current();
+    __vclock_release(mdata);
   }
   __lockset_release(mdata, mdata->owner);
 
@@ -375,7 +360,7 @@ static void _cond_init(pthread_cond_t *cond, const pthread_condattr_t *attr) {
   *((condvar_data_t**)cond) = cdata;
 
   cdata->wlist = klee_get_wlist();
-  __vclock_clear(cdata->vc);
+  __vclock_clear(cdata);
 }
 
 static condvar_data_t *_get_condvar_data(pthread_cond_t *cond) {
@@ -434,9 +419,7 @@ static int _atomic_cond_wait(condvar_data_t *cdata, mutex_data_t *mdata) {
     return -1;
   }
 
-  __vclock_update_current(cdata->vc);
-  __vclock_tock_current();
-  __vclock_send_current();
+  __vclock_acquire(cdata);
 
   return 0;
 }
@@ -450,9 +433,7 @@ int pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex) {
 
 static int _atomic_cond_notify(condvar_data_t *cdata, char all) {
   if (cdata->queued > 0) {
-    __vclock_copy(cdata->vc, __tsync.threads[pthread_self()].vc);
-    __vclock_tock_current();
-    __vclock_send_current();
+    __vclock_release(cdata);
     if (all)
       __thread_notify_all(cdata->wlist);
     else
@@ -488,7 +469,7 @@ static void _barrier_init(pthread_barrier_t *barrier, const pthread_barrierattr_
   bdata->curr_event = 0;
   bdata->init_count = count;
   bdata->left = count;
-  __vclock_clear(bdata->vc);
+  __vclock_clear(bdata);
 }
 
 static barrier_data_t *_get_barrier_data(pthread_barrier_t *barrier) {
@@ -527,11 +508,11 @@ int pthread_barrier_wait(pthread_barrier_t *barrier) {
   }
 
   if (bdata->left == bdata->init_count)
-    __vclock_clear(bdata->vc);
+    __vclock_clear(bdata);
 
   --bdata->left;
 
-  __vclock_update(bdata->vc, __tsync.threads[pthread_self()].vc);
+  __vclock_release_merge(bdata);
 
   if (bdata->left == 0) {
     ++bdata->curr_event;
@@ -545,9 +526,7 @@ int pthread_barrier_wait(pthread_barrier_t *barrier) {
     __thread_sleep(bdata->wlist);
   }
 
-  __vclock_update_current(bdata->vc);
-  __vclock_tock_current();
-  __vclock_send_current();
+  __vclock_acquire(bdata);
 
   return result;
 }
@@ -568,8 +547,10 @@ static void _rwlock_init(pthread_rwlock_t *rwlock, const pthread_rwlockattr_t *a
   rwdata->nr_readers_queued = 0;
   rwdata->nr_writers_queued = 0;
   rwdata->writer_taken = 0;
-  __vclock_clear(rwdata->vc);
-  __vclock_clear(rwdata->write_vc);
+  // The clock of the last writer is published on &rwdata->writer, and the
+  // clock of every unlock on rwdata
+  __vclock_clear(rwdata);
+  __vclock_clear(&rwdata->writer);
 }
 
 static rwlock_data_t *_get_rwlock_data(pthread_rwlock_t *rwlock) {
@@ -611,9 +592,7 @@ static int _atomic_rwlock_rdlock(rwlock_data_t *rwdata, char try) {
       return -1;
     }
 
-    __vclock_update_current(rwdata->write_vc);
-    __vclock_tock_current();
-    __vclock_send_current();
+    __vclock_acquire(&rwdata->writer);
     __lockset_acquire_read(rwdata, pthread_self());
 
     return 0;
@@ -634,9 +613,7 @@ static int _atomic_rwlock_rdlock(rwlock_data_t *rwdata, char try) {
     ++rwdata->nr_readers;
     --rwdata->nr_readers_queued;
 
-    __vclock_update_current(rwdata->write_vc);
-    __vclock_tock_current();
-    __vclock_send_current();
+    __vclock_acquire(&rwdata->writer);
     __lockset_acquire_read(rwdata, pthread_self());
   }
 
@@ -665,9 +642,7 @@ static int _atomic_rwlock_wrlock(rwlock_data_t *rwdata, char try) {
     rwdata->writer = pthread_self();
     rwdata->writer_taken = 1;
 
-    __vclock_update_current(rwdata->vc);
-    __vclock_tock_current();
-    __vclock_send_current();
+    __vclock_acquire(rwdata);
     __lockset_acquire(rwdata, rwdata->writer);
     return 0;
   }
@@ -688,9 +663,7 @@ static int _atomic_rwlock_wrlock(rwlock_data_t *rwdata, char try) {
     rwdata->writer_taken = 1;
     --rwdata->nr_writers_queued;
 
-    __vclock_update_current(rwdata->vc);
-    __vclock_tock_current();
-    __vclock_send_current();
+    __vclock_acquire(rwdata);
     __lockset_acquire(rwdata, rwdata->writer);
   }
 
@@ -718,19 +691,17 @@ static int _atomic_rwlock_unlock(rwlock_data_t *rwdata) {
   if (rwdata->writer_taken && rwdata->writer == pthread_self()) {
     rwdata->writer_taken = 0;
 
-    __vclock_copy(rwdata->write_vc, __tsync.threads[pthread_self()].vc);
-    __vclock_copy(rwdata->vc, __tsync.threads[pthread_self()].vc);
+    __vclock_release(&rwdata->writer);
+    __vclock_release(rwdata);
   } else if (rwdata->writer_taken && rwdata->writer != pthread_self()) {
     errno = EPERM;
     return -1;
   } else {
     if (rwdata->nr_readers > 0)
       --rwdata->nr_readers;
-    __vclock_update(rwdata->vc, __tsync.threads[pthread_self()].vc);
+    __vclock_release_merge(rwdata);
   }
 
-  __vclock_tock_current();
-  __vclock_send_current();
   __lockset_release(rwdata, pthread_self());
 
   if (rwdata->nr_readers == 0 && rwdata->nr_writers_queued)
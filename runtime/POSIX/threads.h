@@ -54,8 +54,6 @@
 #include <klee/klee.h>
 #include <pthread.h>
 
-#define MAX_THREADS     16
-
 typedef uint64_t wlist_id_t;
 
 #define DEFAULT_THREAD  0
@@ -69,8 +67,6 @@ typedef uint64_t wlist_id_t;
 
 #define PTHREAD_BARRIER_SERIAL_THREAD    -1
 
-typedef uint32_t vc_t[MAX_THREADS];
-
 typedef struct {
   wlist_id_t wlist;
 
@@ -79,8 +75,6 @@ typedef struct {
   char allocated;
   char terminated;
   char joinable;
-
-  vc_t vc;
 } thread_data_t;
 
 typedef struct {
@@ -92,8 +86,6 @@ typedef struct {
   unsigned int queued;
 
   char allocated;
-
-  vc_t vc;
 } mutex_data_t;
 
 typedef struct {
@@ -101,8 +93,6 @@ typedef struct {
 
   mutex_data_t *mutex;
   unsigned int queued;
-
-  vc_t vc;
 } condvar_data_t;
 
 typedef struct {
@@ -111,8 +101,6 @@ typedef struct {
   unsigned int curr_event;
   unsigned int left;
   unsigned int init_count;
-
-  vc_t vc;
 } barrier_data_t;
 
 typedef struct {
@@ -124,9 +112,6 @@ typedef struct {
   unsigned int nr_writers_queued;
   unsigned int writer;
   char writer_taken;
-
-  vc_t vc;
-  vc_t write_vc;
 } rwlock_data_t;
 
 typedef struct {
@@ -134,18 +119,27 @@ typedef struct {
 
   int count;
   char allocated;
-
-  vc_t vc;
 } sem_data_t;
 
 typedef struct {
-  thread_data_t threads[MAX_THREADS];
+  // Indexed by thread id and grown on demand. The thread data is allocated
+  // separately and never moves, as its address identifies the thread clock.
+  thread_data_t **threads;
+  unsigned int size;
 } tsync_data_t;
 
 extern tsync_data_t __tsync;
 
 void klee_init_threads(void);
 
+// Data of the tid thread, allocated if needed. Returns 0 if out of memory.
+thread_data_t *__alloc_thread_data(pthread_t tid);
+
+// Data of the tid thread, or 0 if there was never such thread
+static inline thread_data_t *__get_thread_data(pthread_t tid) {
+  return tid < __tsync.size ? __tsync.threads[tid] : 0;
+}
+
 static inline void __thread_sleep(uint64_t wlist) {
   klee_thread_sleep(wlist);
 }
@@ -162,48 +156,27 @@ static inline void __thread_notify_all(uint64_t wlist) {
   __thread_notify(wlist, 1);
 }
 
-static inline void __vclock_print(vc_t vc) {
-  printf("(");
-  int i;
-  for (i=0; i<MAX_THREADS; i++)
-    printf("%i ", vc[i]);
-  printf(")\n");
-}
-
-static inline void __vclock_clear(vc_t vc) {
-  memset(vc, 0, sizeof(vc_t));
-}
-
-static inline void __vclock_tock(pthread_t tid) {
-  __tsync.threads[tid].vc[tid]++;
-}
-
-static inline void __vclock_tock_current() {
-  __vclock_tock(pthread_self());
-}
+// The vector clocks of the threads and of the synchronization objects are
+// kept by KLEE, the objects are identified by their address
 
-static inline void __vclock_update(vc_t target, vc_t received) { // Update target vector clock with received vc
-  int i;
-  for (i = 0; i< MAX_THREADS; ++i) {
-    if (target[i] < received[i])
-      target[i] = received[i];
-  }
+static inline void __vclock_acquire(void *sync) {
+  klee_vclock_acquire(sync);
 }
 
-static inline void __vclock_update_current(vc_t received) { // Update current thread vector clock with specified vc
-  __vclock_update(__tsync.threads[pthread_self()].vc, received);
+static inline void __vclock_release(void *sync) {
+  klee_vclock_release(sync, 0);
 }
 
-static inline void __vclock_copy(vc_t dst, vc_t src) {
-  memcpy(dst, src, sizeof(vc_t));
+static inline void __vclock_release_merge(void *sync) {
+  klee_vclock_release(sync, 1);
 }
 
-static inline void __vclock_send(pthread_t tid) { // Send to KLEE the vector of clock of the specified thread
-  klee_vclock_send(tid, __tsync.threads[tid].vc, MAX_THREADS);
+static inline void __vclock_fork(pthread_t tid) {
+  klee_vclock_fork(tid);
 }
 
-static inline void __vclock_send_current() { // Send to KLEE the vector of clock of the current threa
-  __vclock_send(pthread_self());
+static inline void __vclock_clear(void *sync) {
+  klee_vclock_clear(sync);
 }
 
 static inline void __lockset_update(pthread_t thread, void *mutex, char isAcquire, char isWriteMode) {
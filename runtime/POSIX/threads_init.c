@@ -46,32 +46,45 @@
 
 #include "threads.h"
 
+#include <stdlib.h>
 #include <string.h>
 
 #include <klee/klee.h>
 
 tsync_data_t __tsync;
 
-void klee_init_threads(void) {
-    // Initialize all thread structures
-    int i;
-    for(i = 0; i < MAX_THREADS; i++) {
-        thread_data_t *slot = &__tsync.threads[i];
-        slot->allocated = 0;
-        slot->terminated = 0;
-        slot->ret_value = 0;
-        slot->joinable = 0;
-        slot->wlist = 0;
-        __vclock_clear(slot->vc);
+thread_data_t *__alloc_thread_data(pthread_t tid) {
+    if (tid >= __tsync.size) {
+        unsigned int size = __tsync.size ? __tsync.size : 4;
+        while (size <= tid)
+            size *= 2;
+
+        thread_data_t **threads = (thread_data_t**)realloc(__tsync.threads,
+                                                           size * sizeof(*threads));
+        if (!threads)
+            return 0;
+        memset(threads + __tsync.size, 0, (size - __tsync.size) * sizeof(*threads));
+        __tsync.threads = threads;
+        __tsync.size = size;
     }
 
+    if (!__tsync.threads[tid])
+        __tsync.threads[tid] = (thread_data_t*)calloc(1, sizeof(thread_data_t));
+    return __tsync.threads[tid];
+}
+
+void klee_init_threads(void) {
+    // The thread table grows with the threads created
+    __tsync.threads = 0;
+    __tsync.size = 0;
+
     // Main thread initialization
-    thread_data_t *def_data = &__tsync.threads[DEFAULT_THREAD];
+    thread_data_t *def_data = __alloc_thread_data(DEFAULT_THREAD);
     def_data->allocated = 1;
     def_data->terminated = 0;
     def_data->ret_value = 0;
     def_data->joinable = 1; // Why not?
     def_data->wlist = klee_get_wlist();
-    __vclock_tock_current();
-    __vclock_send_current();
+    // Start the clock of the main thread
+    __vclock_acquire(def_data);
 }
@@ -98,6 +98,20 @@ void klee_silent_exit(int x) {
   exit(x);
 }
 
+void klee_report_error(const char *file, int line, const char *message,
+                       const char *suffix) {
+  fprintf(stderr, "KLEE-RUNTIME: ERROR: %s:%d: %s\n", file, line, message);
+  abort();
+}
+
+void klee_warning(const char *message) {
+  fprintf(stderr, "KLEE-RUNTIME: WARNING: %s\n", message);
+}
+
+void klee_warning_once(const char *message) {
+  fprintf(stderr, "KLEE-RUNTIME: WARNING: %s\n", message);
+}
+
 uintptr_t klee_choose(uintptr_t n) {
   uintptr_t x;
   klee_make_symbolic(&x, sizeof x, "klee_choose");
@@ -0,0 +1,468 @@
+//===-- threads.c ---------------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+/* Native thread scheduler used to replay the schedule of a test case.
+ *
+ * The POSIX runtime thread model is compiled natively and exported in place of
+ * the pthread functions, so the replayed program must link this library before
+ * libpthread. Each model thread runs in its own native thread, but only the
+ * thread holding the baton runs at a time: every scheduling decision of KLEE
+ * (a preemption point, a thread going to sleep or terminating) hands the baton
+ * to the thread recorded in the schedule of the test case. Once the recorded
+ * steps are exhausted the current thread keeps running while it is enabled,
+ * as KLEE does without forking.
+ *
+ * The schedule is read from the .ktest file in KLEE_REPLAY_SCHEDULE, or from
+ * KTEST_FILE when unset. The preemption points inserted by the
+ * ThreadPreemptionPass are placed around the pthread calls of the program
+ * when KLEE_REPLAY_PREEMPT_BEFORE and KLEE_REPLAY_PREEMPT_AFTER_SUCCESS are
+ * set, matching -preempt-before-pthread and -preempt-after-pthread-success.
+ * The pass does not add a preemption point after a call that is directly
+ * followed by another preemption point, which cannot be told natively, so
+ * enabling both may replay extra scheduling steps.
+ */
+
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <dlfcn.h>
+#include <linux/futex.h>
+#include <pthread.h>
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "klee/klee.h"
+
+#include "klee/Internal/ADT/KTest.h"
+
+/* The model functions with a preemption point are renamed, and exported below
+   wrapped by the preemption points of the replayed schedule */
+#define pthread_create          __klee_model_pthread_create
+#define pthread_mutex_lock      __klee_model_pthread_mutex_lock
+#define pthread_mutex_trylock   __klee_model_pthread_mutex_trylock
+#define pthread_mutex_unlock    __klee_model_pthread_mutex_unlock
+#define pthread_cond_wait       __klee_model_pthread_cond_wait
+#define pthread_cond_signal     __klee_model_pthread_cond_signal
+#define pthread_rwlock_rdlock   __klee_model_pthread_rwlock_rdlock
+#define pthread_rwlock_tryrdlock __klee_model_pthread_rwlock_tryrdlock
+#define pthread_rwlock_wrlock   __klee_model_pthread_rwlock_wrlock
+#define pthread_rwlock_trywrlock __klee_model_pthread_rwlock_trywrlock
+#define pthread_rwlock_unlock   __klee_model_pthread_rwlock_unlock
+#define pthread_barrier_wait    __klee_model_pthread_barrier_wait
+#define sem_wait                __klee_model_sem_wait
+#define sem_trywait             __klee_model_sem_trywait
+#define sem_post                __klee_model_sem_post
+
+#include "../POSIX/threads.c"
+#include "../POSIX/threads_init.c"
+#include "../POSIX/semaphores.c"
+
+#undef pthread_create
+#undef pthread_mutex_lock
+#undef pthread_mutex_trylock
+#undef pthread_mutex_unlock
+#undef pthread_cond_wait
+#undef pthread_cond_signal
+#undef pthread_rwlock_rdlock
+#undef pthread_rwlock_tryrdlock
+#undef pthread_rwlock_wrlock
+#undef pthread_rwlock_trywrlock
+#undef pthread_rwlock_unlock
+#undef pthread_barrier_wait
+#undef sem_wait
+#undef sem_trywait
+#undef sem_post
+
+typedef struct {
+  /* Set when the thread is handed the baton */
+  volatile int run;
+
+  char allocated;
+  char enabled;
+  wlist_id_t wlist;
+
+  void *(*start_routine)(void*);
+  void *arg;
+} replay_thread_t;
+
+/* Indexed by thread id and grown on demand. The slots are allocated
+   separately and never move, as the threads wait on their run flag. */
+static replay_thread_t **rthreads = 0;
+static uint64_t numRThreads = 0;
+static uint64_t crtThread = DEFAULT_THREAD;
+static uint64_t wlistCounter = 1;
+
+static KTest *schedule = 0;
+static unsigned scheduleStep = 0;
+static int preemptBefore = 0;
+static int preemptAfterIfSuccess = 0;
+
+/* Set when the program returns from main while other threads are running */
+static int mainExiting = 0;
+static volatile int mainExitDone = 0;
+static jmp_buf mainExitJmp;
+static int explicitExit = 0;
+
+static int (*real_pthread_create)(pthread_t *, const pthread_attr_t *,
+                                  void *(*)(void *), void *) = 0;
+static void (*real_pthread_exit)(void *) __attribute__ ((__noreturn__)) = 0;
+static void (*real_exit)(int) __attribute__ ((__noreturn__)) = 0;
+
+static int initialized = 0;
+
+static void replay_init(void);
+
+static void replay_error(const char *msg) {
+  fprintf(stderr, "KLEE-RUNTIME: ERROR: %s\n", msg);
+  abort();
+}
+
+/* Baton passing */
+
+static void replay_wait(volatile int *flag) {
+  while (!__sync_bool_compare_and_swap(flag, 1, 0))
+    syscall(SYS_futex, flag, FUTEX_WAIT, 0, NULL, NULL, 0);
+}
+
+static void replay_wake(volatile int *flag) {
+  __sync_fetch_and_or(flag, 1);
+  syscall(SYS_futex, flag, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+/* Slot of the tid thread, allocated on first use */
+static replay_thread_t *replay_thread(uint64_t tid) {
+  if (tid >= numRThreads) {
+    uint64_t size = numRThreads ? numRThreads : 4;
+    while (size <= tid)
+      size *= 2;
+    rthreads = realloc(rthreads, size * sizeof(*rthreads));
+    if (!rthreads)
+      replay_error("out of memory");
+    memset(rthreads + numRThreads, 0,
+           (size - numRThreads) * sizeof(*rthreads));
+    numRThreads = size;
+  }
+  if (!rthreads[tid]) {
+    rthreads[tid] = calloc(1, sizeof(replay_thread_t));
+    if (!rthreads[tid])
+      replay_error("out of memory");
+  }
+  return rthreads[tid];
+}
+
+static int replay_thread_exists(uint64_t tid) {
+  return tid < numRThreads && rthreads[tid] && rthreads[tid]->allocated;
+}
+
+static unsigned replay_count_threads(int enabledOnly) {
+  uint64_t i;
+  unsigned count = 0;
+  for (i = 0; i < numRThreads; i++)
+    if (replay_thread_exists(i) && (!enabledOnly || rthreads[i]->enabled))
+      count++;
+  return count;
+}
+
+static uint64_t replay_next_thread(uint64_t tid) {
+  do {
+    tid = (tid + 1) % numRThreads;
+  } while (!replay_thread_exists(tid));
+  return tid;
+}
+
+/* Mirrors Executor::schedule() without forking. Returns after the current
+   thread is handed the baton back, unless it terminates. */
+static void replay_schedule(int yield, int terminateThread) {
+  uint64_t oldTid = crtThread, nextTid = oldTid;
+
+  if (!replay_count_threads(1))
+    replay_error("hang (possible deadlock?)");
+
+  if (schedule && scheduleStep < schedule->numSchedSteps) {
+    nextTid = schedule->schedSteps[scheduleStep++];
+    if (!replay_thread_exists(nextTid))
+      replay_error("replay next thread not found");
+    if (!rthreads[nextTid]->enabled)
+      replay_error("replay next thread is not enabled");
+  } else {
+    if (schedule && scheduleStep == schedule->numSchedSteps) {
+      fprintf(stderr, "KLEE-RUNTIME: replay scheduling steps exhausted, "
+              "start default scheduling\n");
+      scheduleStep++;
+    }
+    if (!rthreads[oldTid]->enabled || yield) {
+      nextTid = replay_next_thread(oldTid);
+      while (!rthreads[nextTid]->enabled)
+        nextTid = replay_next_thread(nextTid);
+    }
+  }
+
+  if (terminateThread)
+    rthreads[oldTid]->allocated = 0;
+
+  if (nextTid == oldTid)
+    return;
+
+  crtThread = nextTid;
+  replay_wake(&rthreads[nextTid]->run);
+  if (!terminateThread)
+    replay_wait(&rthreads[oldTid]->run);
+}
+
+static void *replay_thread_start(void *arg) {
+  // The slot is passed directly, the table may be growing meanwhile
+  replay_thread_t *t = arg;
+
+  replay_wait(&t->run);
+  // As KLEE does, returning from the start routine exits the thread
+  pthread_exit(t->start_routine(t->arg));
+}
+
+/* Called when the program returns from main, or calls exit() */
+static void replay_exit(void) {
+  if (explicitExit || replay_count_threads(0) == 1)
+    return;
+
+  // The other threads keep running, as if main called pthread_exit()
+  mainExiting = 1;
+  if (!setjmp(mainExitJmp))
+    pthread_exit(0);
+}
+
+void exit(int status) {
+  replay_init();
+  explicitExit = 1;
+  real_exit(status);
+}
+
+static void replay_load_schedule(void) {
+  const char *name = getenv("KLEE_REPLAY_SCHEDULE");
+  if (!name)
+    name = getenv("KTEST_FILE");
+  if (!name)
+    return;
+
+  schedule = kTest_fromFile(name);
+  if (!schedule) {
+    fprintf(stderr, "KLEE-RUNTIME: unable to open .ktest file\n");
+    real_exit(1);
+  }
+}
+
+static void replay_init(void) {
+  if (initialized)
+    return;
+  initialized = 1;
+
+  real_pthread_create = dlsym(RTLD_NEXT, "pthread_create");
+  real_pthread_exit = dlsym(RTLD_NEXT, "pthread_exit");
+  real_exit = dlsym(RTLD_NEXT, "exit");
+  if (!real_pthread_create || !real_pthread_exit || !real_exit) {
+    fprintf(stderr, "KLEE-RUNTIME: unable to find the native thread functions\n");
+    abort();
+  }
+
+  preemptBefore = getenv("KLEE_REPLAY_PREEMPT_BEFORE") != 0;
+  preemptAfterIfSuccess = getenv("KLEE_REPLAY_PREEMPT_AFTER_SUCCESS") != 0;
+  replay_load_schedule();
+
+  replay_thread(DEFAULT_THREAD)->allocated = 1;
+  replay_thread(DEFAULT_THREAD)->enabled = 1;
+  klee_init_threads();
+  atexit(replay_exit);
+}
+
+static void __attribute__ ((constructor)) replay_init_constructor(void) {
+  replay_init();
+}
+
+/* Native implementation of the thread intrinsics */
+
+void klee_thread_create(uint64_t tid, void *(*start_routine)(void*), void *arg) {
+  pthread_t native;
+  replay_thread_t *t;
+
+  replay_init();
+  t = replay_thread(tid);
+  assert(!t->allocated && "thread already exists");
+  t->allocated = 1;
+  t->enabled = 1;
+  t->run = 0;
+  t->wlist = 0;
+  t->start_routine = start_routine;
+  t->arg = arg;
+
+  if (real_pthread_create(&native, 0, replay_thread_start, t))
+    replay_error("unable to create a native thread");
+}
+
+void klee_thread_terminate() {
+  int isMainExit;
+
+  replay_init();
+  isMainExit = mainExiting && crtThread == DEFAULT_THREAD;
+
+  if (replay_count_threads(0) == 1) {
+    // Last thread, the program ends
+    rthreads[crtThread]->allocated = 0;
+    if (isMainExit)
+      longjmp(mainExitJmp, 1);
+    if (mainExiting)
+      replay_wake(&mainExitDone);
+    real_pthread_exit(0);
+  }
+
+  rthreads[crtThread]->enabled = 0;
+  replay_schedule(0, 1);
+
+  if (isMainExit) {
+    replay_wait(&mainExitDone);
+    longjmp(mainExitJmp, 1);
+  }
+  real_pthread_exit(0);
+}
+
+void klee_get_context(uint64_t *tid) {
+  replay_init();
+  if (tid)
+    *tid = crtThread;
+}
+
+uint64_t klee_get_wlist(void) {
+  return wlistCounter++;
+}
+
+void klee_thread_preempt(int yield) {
+  replay_init();
+  replay_schedule(yield, 0);
+}
+
+void klee_thread_sleep(uint64_t wlist) {
+  replay_init();
+  rthreads[crtThread]->enabled = 0;
+  rthreads[crtThread]->wlist = wlist;
+  replay_schedule(0, 0);
+}
+
+void klee_thread_notify(uint64_t wlist, int all) {
+  uint64_t i;
+
+  replay_init();
+  // As KLEE does without forking, the first thread waiting is notified
+  for (i = 0; i < numRThreads; i++) {
+    replay_thread_t *t = rthreads[i];
+    if (t && t->allocated && !t->enabled && t->wlist == wlist) {
+      t->enabled = 1;
+      t->wlist = 0;
+      if (!all)
+        break;
+    }
+  }
+}
+
+/* Race detection is not done natively */
+
+void klee_vclock_send(uint64_t tid, void *vc, size_t nelements) {
+}
+
+void klee_vclock_acquire(void *sync) {
+}
+
+void klee_vclock_release(void *sync, char merge) {
+}
+
+void klee_vclock_fork(uint64_t tid) {
+}
+
+void klee_vclock_clear(void *sync) {
+}
+
+void klee_lockset_update(uint64_t tid, void *mutex, char isAcquire, char isWriteMode) {
+}
+
+/* Exported pthread functions with the preemption points of the
+   ThreadPreemptionPass */
+
+#define PREEMPTION_POINTS(call, success)                \
+  int ret;                                              \
+  replay_init();                                        \
+  if (preemptBefore)                                    \
+    klee_thread_preempt(0);                             \
+  ret = call;                                           \
+  if (preemptAfterIfSuccess && ret == (success))        \
+    klee_thread_preempt(0);                             \
+  return ret;
+
+int pthread_create(pthread_t *thread, const pthread_attr_t *attr,
+                   void *(*start_routine)(void*), void *arg) {
+  PREEMPTION_POINTS(__klee_model_pthread_create(thread, attr, start_routine, arg), 0)
+}
+
+int pthread_mutex_lock(pthread_mutex_t *mutex) {
+  PREEMPTION_POINTS(__klee_model_pthread_mutex_lock(mutex), 0)
+}
+
+int pthread_mutex_trylock(pthread_mutex_t *mutex) {
+  PREEMPTION_POINTS(__klee_model_pthread_mutex_trylock(mutex), 0)
+}
+
+int pthread_mutex_unlock(pthread_mutex_t *mutex) {
+  PREEMPTION_POINTS(__klee_model_pthread_mutex_unlock(mutex), 0)
+}
+
+int pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex) {
+  PREEMPTION_POINTS(__klee_model_pthread_cond_wait(cond, mutex), 0)
+}
+
+int pthread_cond_signal(pthread_cond_t *cond) {
+  PREEMPTION_POINTS(__klee_model_pthread_cond_signal(cond), 0)
+}
+
+int pthread_rwlock_rdlock(pthread_rwlock_t *rwlock) {
+  PREEMPTION_POINTS(__klee_model_pthread_rwlock_rdlock(rwlock), 0)
+}
+
+int pthread_rwlock_tryrdlock(pthread_rwlock_t *rwlock) {
+  PREEMPTION_POINTS(__klee_model_pthread_rwlock_tryrdlock(rwlock), 0)
+}
+
+int pthread_rwlock_wrlock(pthread_rwlock_t *rwlock) {
+  PREEMPTION_POINTS(__klee_model_pthread_rwlock_wrlock(rwlock), 0)
+}
+
+int pthread_rwlock_trywrlock(pthread_rwlock_t *rwlock) {
+  PREEMPTION_POINTS(__klee_model_pthread_rwlock_trywrlock(rwlock), 0)
+}
+
+int pthread_rwlock_unlock(pthread_rwlock_t *rwlock) {
+  PREEMPTION_POINTS(__klee_model_pthread_rwlock_unlock(rwlock), 0)
+}
+
+int pthread_barrier_wait(pthread_barrier_t *barrier) {
+  PREEMPTION_POINTS(__klee_model_pthread_barrier_wait(barrier),
+                    PTHREAD_BARRIER_SERIAL_THREAD)
+}
+
+int sem_wait(sem_posix_t *sem) {
+  PREEMPTION_POINTS(__klee_model_sem_wait(sem), 0)
+}
+
+int sem_trywait(sem_posix_t *sem) {
+  PREEMPTION_POINTS(__klee_model_sem_trywait(sem), 0)
+}
+
+int sem_post(sem_posix_t *sem) {
+  PREEMPTION_POINTS(__klee_model_sem_post(sem), 0)
+}
+
+#undef PREEMPTION_POINTS
@@ -0,0 +1,30 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -g -o %t1.bc
+// RUN: rm -rf %t.klee-out %t.nopreempt-out
+// RUN: %klee --output-dir=%t.nopreempt-out --posix-runtime --libc=uclibc --instrument-all %t1.bc
+// RUN: not ls %t.nopreempt-out/*.assert.err
+// RUN: %klee --output-dir=%t.klee-out --posix-runtime --libc=uclibc --instrument-all --preempt-before-access=shared --preempt-access-budget=4 %t1.bc
+// RUN: ls %t.klee-out/*.assert.err
+// RUN: grep -q PreemptionStatesAccess %t.klee-out/run.stats
+
+#include <assert.h>
+#include <pthread.h>
+#include <klee/klee.h>
+int x;
+
+// The intermediate value is only seen with a context switch between the
+// two plain writes
+static void *th_task(void * v)
+{
+    x = 1;
+    x = 0;
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	pthread_t t;
+	pthread_create(&t, NULL, th_task, NULL);
+    assert(x != 1);
+	pthread_join(t, NULL);
+	return 0;
+}
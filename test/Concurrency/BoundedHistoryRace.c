@@ -0,0 +1,30 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -g -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --posix-runtime --libc=uclibc --preempt-after-pthread-success --instrument-all --race-detection=hb -race-history-size=16 %t1.bc
+// RUN: test -f %t.klee-out/test000001.race
+
+#include <pthread.h>
+#include <klee/klee.h>
+int x;
+int a[64], b[64];
+
+static void *th_task(void * v)
+{
+    int i;
+    for (i = 0; i < 64; i++)
+      a[i] = i;
+    x++;
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	pthread_t t;
+    int i;
+	pthread_create(&t, NULL, th_task, NULL);
+    for (i = 0; i < 64; i++)
+      b[i] = i;
+    x++;
+	pthread_join(t, NULL);
+	return 0;
+}
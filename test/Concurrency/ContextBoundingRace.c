@@ -0,0 +1,28 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -g -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --posix-runtime --libc=uclibc --preempt-after-pthread-success --instrument-all --race-detection=hb -fork-on-schedule --use-iterative-context-bounding %t1.bc
+// RUN: test -f %t.klee-out/test000001.race
+
+#include <pthread.h>
+#include <klee/klee.h>
+int x;
+pthread_mutex_t m = PTHREAD_MUTEX_INITIALIZER;
+
+static void *th_task(void * v)
+{
+    pthread_mutex_lock(&m);
+    pthread_mutex_unlock(&m);
+    x++;
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	pthread_t a;
+	pthread_create(&a, NULL, th_task, NULL);
+    pthread_mutex_lock(&m);
+    pthread_mutex_unlock(&m);
+    x++;
+	pthread_join(a, NULL);
+	return 0;
+}
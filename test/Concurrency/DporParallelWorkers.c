@@ -0,0 +1,38 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -g -o %t1.bc
+// RUN: rm -rf %t.klee-out %t.parallel-out
+// RUN: %klee --output-dir=%t.klee-out --posix-runtime --libc=uclibc --preempt-after-pthread-success --preempt-before-access=shared --instrument-all --race-detection=hb -dpor -no-scheduler-bound %t1.bc 2> %t.log
+// RUN: %klee --output-dir=%t.parallel-out --posix-runtime --libc=uclibc --preempt-after-pthread-success --preempt-before-access=shared --instrument-all --race-detection=hb -dpor -no-scheduler-bound -parallel-workers=2 %t1.bc 2> %t.parallel.log
+// RUN: /bin/sh -c "test `grep -c 'completed paths = ' %t.parallel.log` -eq 2"
+// The workers explore the same schedules as a single process, once each
+// RUN: /bin/sh -c "test `sed -n 's/.*completed paths = //p' %t.log` -eq `sed -n 's/.*completed paths = //p' %t.parallel.log | awk '{ s += $1 } END { print s }'`"
+#include <pthread.h>
+#include <klee/klee.h>
+
+int a, b, x;
+
+static void *th_task(void *v)
+{
+  a = 1;
+  x++;
+  a = 2;
+  return 0;
+}
+
+int main(int argc, char *argv[])
+{
+  pthread_t t;
+  int n;
+  klee_make_symbolic(&n, sizeof(n), "n");
+
+  // Each worker gets one of the branches, along with its schedule points
+  if (n > 0)
+    b = 1;
+  else
+    b = 2;
+
+  pthread_create(&t, 0, th_task, 0);
+  b = 3;
+  x++;
+  pthread_join(t, NULL);
+  return 0;
+}
@@ -0,0 +1,33 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -g -o %t1.bc
+// RUN: rm -rf %t.klee-out %t.fork-out
+// RUN: %klee --output-dir=%t.klee-out --posix-runtime --libc=uclibc --preempt-after-pthread-success --preempt-before-access=shared --instrument-all --race-detection=hb -dpor -no-scheduler-bound %t1.bc 2> %t.log
+// RUN: test -f %t.klee-out/test000001.race
+// RUN: grep "pruned [1-9][0-9]* equivalent schedules" %t.log
+// RUN: %klee --output-dir=%t.fork-out --posix-runtime --libc=uclibc --preempt-after-pthread-success --preempt-before-access=shared --instrument-all --race-detection=hb -fork-on-schedule -no-scheduler-bound %t1.bc 2> %t.fork.log
+// RUN: test -f %t.fork-out/test000001.race
+// Only the schedules reordering the accesses to x are explored by DPOR
+// RUN: /bin/sh -c "test `sed -n 's/.*completed paths = //p' %t.log` -lt `sed -n 's/.*completed paths = //p' %t.fork.log`"
+#include <pthread.h>
+
+int a, b, x;
+
+static void *th_task(void *v)
+{
+  a = 1;
+  a = 2;
+  a = 3;
+  x++;
+  return 0;
+}
+
+int main(int argc, char *argv[])
+{
+  pthread_t t;
+  pthread_create(&t, 0, th_task, 0);
+  b = 1;
+  b = 2;
+  b = 3;
+  x++;
+  pthread_join(t, NULL);
+  return 0;
+}
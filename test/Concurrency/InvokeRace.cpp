@@ -0,0 +1,31 @@
+// RUN: %llvmgxx %s -emit-llvm -O0 -c -g -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --posix-runtime --libc=uclibc --preempt-after-pthread-success --instrument-all --race-detection=hb %t1.bc
+// RUN: test -f %t.klee-out/test000001.race
+
+// The thread only reaches bump() through an invoke, which must still count
+// as thread code when pruning the accesses to main-only globals
+#include <pthread.h>
+int x;
+
+struct Guard {
+  ~Guard() {}
+};
+
+static void bump() {
+  x++;
+}
+
+static void *th_task(void *v) {
+  Guard g;
+  bump();
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  pthread_t a;
+  pthread_create(&a, 0, th_task, 0);
+  x++;
+  pthread_join(a, 0);
+  return 0;
+}
@@ -0,0 +1,29 @@
+// RUN: %llvmgcc %s -emit-llvm -O1 -c -g -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --posix-runtime --libc=uclibc --instrument-all --preempt-before-access=shared --preempt-access-budget=4 %t1.bc 2> %t.log
+// RUN: grep "not coalescing loop accesses" %t.log
+// RUN: ls %t.klee-out/*.assert.err
+
+#include <assert.h>
+#include <pthread.h>
+int a[64];
+
+// The loop would be coalesced into a single range access after it, leaving
+// no preemption point between its writes
+static void *th_task(void * v)
+{
+    int i, n = (int) (long) v;
+    for (i = 0; i < n; i++)
+        a[i] = 1;
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	pthread_t t;
+	pthread_create(&t, NULL, th_task, (void *) 8);
+    // Only fails with a context switch in the middle of the loop
+    assert(a[0] != 1 || a[7] == 1);
+	pthread_join(t, NULL);
+	return 0;
+}
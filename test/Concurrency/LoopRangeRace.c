@@ -0,0 +1,26 @@
+// RUN: %llvmgcc %s -emit-llvm -O1 -c -g -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --posix-runtime --libc=uclibc --preempt-after-pthread-success --instrument-all --race-detection=hb %t1.bc
+// RUN: test -f %t.klee-out/test000001.race
+
+#include <pthread.h>
+#include <klee/klee.h>
+int a[64];
+
+static void *th_task(void * v)
+{
+    int i, n = (int) (long) v;
+    for (i = 0; i < n; i++)
+      a[i] = i;
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	pthread_t t;
+    int x;
+	pthread_create(&t, NULL, th_task, (void *) 64);
+    x = a[40];
+	pthread_join(t, NULL);
+	return x;
+}
@@ -0,0 +1,34 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -g -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --posix-runtime --libc=uclibc --preempt-after-pthread-success --instrument-all --race-detection=hb %t1.bc
+// RUN: test -f %t.klee-out/test000001.race
+
+#include <pthread.h>
+#include <klee/klee.h>
+
+// More threads than the runtime used to support
+#define NTHREADS 24
+
+int a[NTHREADS];
+int x;
+
+static void *th_task(void * v)
+{
+    int i = (int) (long) v;
+    a[i] = i;
+    if (i == NTHREADS - 1)
+      x++;
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	pthread_t t[NTHREADS];
+    int i;
+    for (i = 0; i < NTHREADS; i++)
+	  pthread_create(&t[i], NULL, th_task, (void *) (long) i);
+    x++;
+    for (i = 0; i < NTHREADS; i++)
+	  pthread_join(t[i], NULL);
+	return 0;
+}
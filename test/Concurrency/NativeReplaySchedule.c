@@ -0,0 +1,36 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -g -o %t1.bc
+// RUN: rm -rf %t.klee-out %t.corrupt.ktest
+// RUN: %klee --output-dir=%t.klee-out --posix-runtime --libc=uclibc --preempt-after-pthread-success --instrument-all --race-detection=hb -fork-on-schedule -no-scheduler-bound %t1.bc
+// RUN: ls %t.klee-out/*.assert.err
+// RUN: %cc %s %libkleeruntest -o %t.exe
+// Without a schedule, main keeps running past the assertion
+// RUN: %t.exe
+// The schedule of the failing test case runs the thread first
+// RUN: not /bin/sh -c "KLEE_REPLAY_PREEMPT_AFTER_SUCCESS=1 KLEE_REPLAY_SCHEDULE=`ls %t.klee-out/*.assert.err | sed 's/assert.err$/ktest/'` %t.exe" 2> %t.replay.log
+// RUN: grep "Assertion" %t.replay.log
+// The last two steps, the thread then main again, are replaced by main twice,
+// which is asleep in pthread_join() at the second step
+// RUN: /bin/sh -c "head -c -16 `ls %t.klee-out/*.assert.err | sed 's/assert.err$/ktest/'` > %t.corrupt.ktest"
+// RUN: /bin/sh -c "printf '\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000' >> %t.corrupt.ktest"
+// RUN: not /bin/sh -c "KLEE_REPLAY_PREEMPT_AFTER_SUCCESS=1 KLEE_REPLAY_SCHEDULE=%t.corrupt.ktest %t.exe" 2> %t.corrupt.log
+// RUN: grep "replay next thread is not enabled" %t.corrupt.log
+#include <assert.h>
+#include <pthread.h>
+
+int x;
+
+static void *th_task(void *v)
+{
+  x = 1;
+  return 0;
+}
+
+int main(int argc, char *argv[])
+{
+  pthread_t t;
+  pthread_create(&t, 0, th_task, 0);
+  // Only fails when the thread runs right after being created
+  assert(x != 1);
+  pthread_join(t, NULL);
+  return 0;
+}
@@ -0,0 +1,40 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -g -o %t1.bc
+// RUN: rm -rf %t.default-out %t.klee-out %t.path-out
+// RUN: %klee --output-dir=%t.default-out --posix-runtime --libc=uclibc --preempt-after-pthread-success %t1.bc
+// RUN: not ls %t.default-out/*.assert.err
+// RUN: %klee --output-dir=%t.klee-out --rng-seed=1 --posix-runtime --libc=uclibc --preempt-after-pthread-success -pct -pct-depth=2 -pct-sched-steps=20 -pct-trials=500 %t1.bc 2> %t.log
+// RUN: ls %t.klee-out/*.assert.err
+// Every trial runs its single path to completion with the default search
+// RUN: grep "completed paths = 500" %t.log
+// RUN: %klee --output-dir=%t.path-out --search=random-path --rng-seed=1 --posix-runtime --libc=uclibc --preempt-after-pthread-success -pct -pct-trials=4 %t1.bc 2> %t.path.log
+// RUN: grep "completed paths = 4" %t.path.log
+
+#include <assert.h>
+#include <pthread.h>
+int x;
+pthread_mutex_t m = PTHREAD_MUTEX_INITIALIZER;
+
+// x is only 1 between the two critical sections of the thread
+static void *th_task(void * v)
+{
+    pthread_mutex_lock(&m);
+    x = 1;
+    pthread_mutex_unlock(&m);
+    pthread_mutex_lock(&m);
+    x = 0;
+    pthread_mutex_unlock(&m);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	pthread_t t;
+	pthread_create(&t, NULL, th_task, NULL);
+    // Depth 2 bug: the thread must run first, then lose its priority
+    // between its critical sections. The default schedule keeps running main.
+    pthread_mutex_lock(&m);
+    assert(x != 1);
+    pthread_mutex_unlock(&m);
+	pthread_join(t, NULL);
+	return 0;
+}
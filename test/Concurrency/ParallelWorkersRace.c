@@ -0,0 +1,34 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -g -o %t1.bc
+// RUN: rm -rf %t.klee-out %t.parallel-out
+// RUN: %klee --output-dir=%t.klee-out --posix-runtime --libc=uclibc --preempt-after-pthread-success --instrument-all --race-detection=hb -fork-on-schedule -no-scheduler-bound %t1.bc 2>%t.log
+// RUN: %klee --output-dir=%t.parallel-out --posix-runtime --libc=uclibc --preempt-after-pthread-success --instrument-all --race-detection=hb -fork-on-schedule -no-scheduler-bound -parallel-workers=2 %t1.bc 2>%t.parallel.log
+// RUN: /bin/sh -c "test `grep -c 'generated tests = ' %t.parallel.log` -eq 2"
+// RUN: /bin/sh -c "test `ls %t.parallel-out | grep -c 'race$'` -eq 1"
+// The workers explore the same schedules as a single process, once each
+// RUN: /bin/sh -c "test `sed -n 's/.*completed paths = //p' %t.log` -eq `sed -n 's/.*completed paths = //p' %t.parallel.log | awk '{ s += $1 } END { print s }'`"
+// Test ids collide if a worker overwrites the test cases of the other one
+// RUN: /bin/sh -c "test `ls %t.parallel-out | grep -c 'ktest$'` -eq `sed -n 's/.*generated tests = //p' %t.parallel.log | awk '{ s += $1 } END { print s }'`"
+#include <pthread.h>
+
+int x;
+pthread_mutex_t m = PTHREAD_MUTEX_INITIALIZER;
+
+// The preemption points after the pthread calls interleave the threads in
+// many schedules, which all race on x
+static void *task(void *v)
+{
+  pthread_mutex_lock(&m);
+  pthread_mutex_unlock(&m);
+  x++;
+  return 0;
+}
+
+int main(int argc, char *argv[])
+{
+  pthread_t a, b;
+  pthread_create(&a, 0, task, 0);
+  pthread_create(&b, 0, task, 0);
+  pthread_join(a, NULL);
+  pthread_join(b, NULL);
+  return 0;
+}
@@ -0,0 +1,35 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -g -o %t1.bc
+// RUN: rm -rf %t.klee-out %t.main-out %t.worker-out %t.partition
+// RUN: %klee --output-dir=%t.klee-out --posix-runtime --libc=uclibc --preempt-after-pthread-success --instrument-all --race-detection=hb -fork-on-schedule -no-scheduler-bound %t1.bc 2>%t.log
+// RUN: %klee --output-dir=%t.main-out --posix-runtime --libc=uclibc --preempt-after-pthread-success --instrument-all --race-detection=hb -fork-on-schedule -no-scheduler-bound -sched-partition-dir=%t.partition -sched-partition-states=1 %t1.bc 2>%t.partition.log
+// RUN: ls %t.partition/pending | grep ktest
+// RUN: %klee --output-dir=%t.worker-out --posix-runtime --libc=uclibc --preempt-after-pthread-success --instrument-all --race-detection=hb -fork-on-schedule -no-scheduler-bound -sched-partition-dir=%t.partition -sched-partition-worker %t1.bc 2>>%t.partition.log
+// RUN: ls %t.partition/done | grep ktest
+// RUN: ls %t.partition/races | grep race
+// The main run and the worker explore the same schedules as a single
+// process, once each
+// RUN: /bin/sh -c "test `sed -n 's/.*completed paths = //p' %t.log` -eq `sed -n 's/.*completed paths = //p' %t.partition.log | awk '{ s += $1 } END { print s }'`"
+#include <pthread.h>
+
+int x;
+pthread_mutex_t m = PTHREAD_MUTEX_INITIALIZER;
+
+// The preemption points after the pthread calls interleave the threads in
+// many schedules, which all race on x
+static void *task(void *v)
+{
+  pthread_mutex_lock(&m);
+  pthread_mutex_unlock(&m);
+  x++;
+  return 0;
+}
+
+int main(int argc, char *argv[])
+{
+  pthread_t a, b;
+  pthread_create(&a, 0, task, 0);
+  pthread_create(&b, 0, task, 0);
+  pthread_join(a, NULL);
+  pthread_join(b, NULL);
+  return 0;
+}
@@ -0,0 +1,43 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -g -o %t1.bc
+// RUN: rm -rf %t.klee-out %t.noprune-out %t.locked-out %t.locked-noprune-out
+// RUN: %klee --output-dir=%t.klee-out --posix-runtime --libc=uclibc --preempt-after-pthread-success --instrument-all --race-detection=hb %t1.bc
+// RUN: not ls %t.klee-out/*.race
+// RUN: %klee --output-dir=%t.noprune-out --posix-runtime --libc=uclibc --preempt-after-pthread-success --instrument-all --instrument-prune-accesses=false --race-detection=hb %t1.bc
+// RUN: not ls %t.noprune-out/*.race
+// The MemoryAccesses column of run.stats drops with the main-only global
+// RUN: /bin/sh -c "test `awk -F, 'NR == 1 { for (i = 1; i <= NF; i++) if ($i ~ /MemoryAccesses/) c = i } END { print $c }' %t.klee-out/run.stats` -lt `awk -F, 'NR == 1 { for (i = 1; i <= NF; i++) if ($i ~ /MemoryAccesses/) c = i } END { print $c }' %t.noprune-out/run.stats`"
+// The accesses to the lock-protected global alone are still logged, but are
+// no longer race candidates
+// RUN: %llvmgcc %s -DLOCKED_ONLY -emit-llvm -O0 -c -g -o %t2.bc
+// RUN: %klee --output-dir=%t.locked-out --posix-runtime --libc=uclibc --preempt-after-pthread-success --instrument-all --race-detection=hb %t2.bc
+// RUN: %klee --output-dir=%t.locked-noprune-out --posix-runtime --libc=uclibc --preempt-after-pthread-success --instrument-all --instrument-prune-accesses=false --race-detection=hb %t2.bc
+// RUN: /bin/sh -c "test `awk -F, 'NR == 1 { for (i = 1; i <= NF; i++) if ($i ~ /RaceCandidates/) c = i } END { print $c }' %t.locked-out/run.stats` -lt `awk -F, 'NR == 1 { for (i = 1; i <= NF; i++) if ($i ~ /RaceCandidates/) c = i } END { print $c }' %t.locked-noprune-out/run.stats`"
+
+#include <pthread.h>
+#include <klee/klee.h>
+int locked, mainOnly;
+pthread_mutex_t m = PTHREAD_MUTEX_INITIALIZER;
+
+static void *th_task(void * v)
+{
+    pthread_mutex_lock(&m);
+    locked++;
+    pthread_mutex_unlock(&m);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	pthread_t a;
+#ifndef LOCKED_ONLY
+    int i;
+    for (i = 0; i < 8; i++)
+      mainOnly += i;
+#endif
+	pthread_create(&a, NULL, th_task, NULL);
+    pthread_mutex_lock(&m);
+    locked++;
+    pthread_mutex_unlock(&m);
+	pthread_join(a, NULL);
+	return mainOnly;
+}
@@ -0,0 +1,25 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -g -o %t1.bc
+// RUN: rm -rf %t.klee-out %t.klee-out2 %t.racedb
+// RUN: %klee --output-dir=%t.klee-out --posix-runtime --libc=uclibc --preempt-after-pthread-success --instrument-all --race-detection=hb -race-db=%t.racedb %t1.bc
+// RUN: test -f %t.klee-out/test000001.race
+// RUN: %klee --output-dir=%t.klee-out2 --posix-runtime --libc=uclibc --preempt-after-pthread-success --instrument-all --race-detection=hb -race-db=%t.racedb %t1.bc
+// RUN: not ls %t.klee-out2/*.race
+
+#include <pthread.h>
+#include <klee/klee.h>
+int x;
+
+static void *th_task(void * v)
+{
+    x++;
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	pthread_t t;
+	pthread_create(&t, NULL, th_task, NULL);
+    x++;
+	pthread_join(t, NULL);
+	return 0;
+}
@@ -0,0 +1,39 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -g -o %t1.bc
+// RUN: rm -rf %t.klee-out %t.replay-out %t.explore-out
+// RUN: %klee --output-dir=%t.klee-out --posix-runtime --libc=uclibc --preempt-after-pthread-success --instrument-all --race-detection=hb %t1.bc
+// RUN: test -f %t.klee-out/test000001.race
+// RUN: %klee --output-dir=%t.replay-out --posix-runtime --libc=uclibc --preempt-after-pthread-success --instrument-all --race-detection=hb --replay-out=%t.klee-out/test000001.ktest -replay-fast-forward %t1.bc
+// RUN: test -f %t.replay-out/test000001.ktest
+// RUN: not ls %t.replay-out/*.race
+// Only the step after the first pthread_create() is replayed, so the race
+// with the second thread is found again and its schedules are forked
+// RUN: %klee --output-dir=%t.explore-out --posix-runtime --libc=uclibc --preempt-after-pthread-success --instrument-all --race-detection=hb -fork-on-schedule -no-scheduler-bound --replay-out=%t.klee-out/test000001.ktest -replay-fast-forward -replay-explore-from=1 %t1.bc
+// RUN: ls %t.explore-out/*.race
+// RUN: /bin/sh -c "test `ls %t.explore-out | grep -c 'ktest$'` -gt 1"
+
+#include <pthread.h>
+#include <klee/klee.h>
+int x, y;
+
+static void *first_task(void * v)
+{
+    y++;
+	return 0;
+}
+
+static void *second_task(void * v)
+{
+    x++;
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	pthread_t t;
+	pthread_create(&t, NULL, first_task, NULL);
+	pthread_join(t, NULL);
+	pthread_create(&t, NULL, second_task, NULL);
+    x++;
+	pthread_join(t, NULL);
+	return 0;
+}
@@ -0,0 +1,28 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -g -o %t1.bc
+// RUN: %klee --no-output --exit-on-error --posix-runtime --libc=uclibc --preempt-after-pthread-success --instrument-all --race-detection=hb %t1.bc
+
+#include <pthread.h>
+#include <klee/klee.h>
+int x, y;
+pthread_rwlock_t l;
+static void *th_task(void * v)
+{
+    pthread_rwlock_wrlock(&l);
+    x++;
+    pthread_rwlock_unlock(&l);
+    y = 1;
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	pthread_t a;
+    int r;
+    pthread_rwlock_init(&l, NULL);
+	pthread_create(&a, NULL, th_task, NULL);
+    pthread_rwlock_rdlock(&l);
+    r = x;
+    pthread_rwlock_unlock(&l);
+	pthread_join(a, NULL);
+	return r + y;
+}
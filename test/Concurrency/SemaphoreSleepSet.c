@@ -0,0 +1,30 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -g -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --posix-runtime --libc=uclibc --preempt-after-pthread-success --instrument-all -fork-on-schedule -sleep-sets -no-scheduler-bound %t1.bc
+// The post only touches the runtime state of the semaphore, but it still
+// depends on the trywait, so the order where the trywait succeeds is explored
+// RUN: ls %t.klee-out/*.assert.err
+
+#include <assert.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+sem_t s;
+
+static void *th_task(void *v)
+{
+  sem_post(&s);
+  return 0;
+}
+
+int main(int argc, char *argv[])
+{
+  pthread_t t;
+  int r;
+  sem_init(&s, 0, 0);
+  pthread_create(&t, 0, th_task, 0);
+  r = sem_trywait(&s);
+  pthread_join(t, NULL);
+  assert(r != 0);
+  return 0;
+}
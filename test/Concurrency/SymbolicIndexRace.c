@@ -0,0 +1,29 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -g -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --posix-runtime --libc=uclibc --preempt-after-pthread-success --instrument-all --race-detection=hb %t1.bc
+// RUN: test -f %t.klee-out/test000001.race
+
+#include <pthread.h>
+#include <klee/klee.h>
+int data[8];
+int idx;
+
+static void *th_task(void * v)
+{
+    // Only the access to data[idx] must overlap the one in main
+    data[idx] = 1;
+    data[(idx + 4) % 8] = 1;
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	pthread_t a;
+	klee_make_symbolic(&idx, sizeof(idx), "idx");
+	klee_assume(idx >= 0);
+	klee_assume(idx < 4);
+	pthread_create(&a, NULL, th_task, NULL);
+    data[idx] = 2;
+	pthread_join(a, NULL);
+	return 0;
+}
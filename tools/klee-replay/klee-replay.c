@@ -42,6 +42,8 @@ static char *rootdir = NULL;
 static struct option long_options[] = {
   {"create-files-only", required_argument, 0, 'f'},
   {"chroot-to-dir", required_argument, 0, 'r'},
+  {"preempt-before-pthread", no_argument, 0, 'b'},
+  {"preempt-after-pthread-success", no_argument, 0, 'a'},
   {"help", no_argument, 0, 'h'},
   {0, 0, 0, 0},
 };
@@ -249,9 +251,15 @@ static void usage(void) {
   fprintf(stderr, "   or: %s --create-files-only <ktest-file>\n", progname);
   fprintf(stderr, "\n");
   fprintf(stderr, "-r, --chroot-to-dir=DIR  use chroot jail, requires CAP_SYS_CHROOT\n");
+  fprintf(stderr, "    --preempt-before-pthread         replay the schedule with preemption\n");
+  fprintf(stderr, "                                     points before pthread calls\n");
+  fprintf(stderr, "    --preempt-after-pthread-success  replay the schedule with preemption\n");
+  fprintf(stderr, "                                     points after successful pthread calls\n");
   fprintf(stderr, "-h, --help               display this help and exit\n");
   fprintf(stderr, "\n");
   fprintf(stderr, "Use KLEE_REPLAY_TIMEOUT environment variable to set a timeout (in seconds).\n");
+  fprintf(stderr, "The thread schedule is enforced when the executable is linked with libkleeRuntest,\n");
+  fprintf(stderr, "using the options of the ThreadPreemptionPass given to KLEE.\n");
   exit(1);
 }
 
@@ -294,6 +302,14 @@ int main(int argc, char** argv) {
       case 'r':
         rootdir = optarg;
         break;
+      /* The preemption points are placed by the runtime of the replayed
+         program, see runtime/Runtest/threads.c */
+      case 'b':
+        setenv("KLEE_REPLAY_PREEMPT_BEFORE", "1", 1);
+        break;
+      case 'a':
+        setenv("KLEE_REPLAY_PREEMPT_AFTER_SUCCESS", "1", 1);
+        break;
     }
   }
 
@@ -349,6 +365,8 @@ int main(int argc, char** argv) {
       fprintf(stderr, "\"%s\" ", prg_argv[i]); 
     }
     fprintf(stderr, "\n");
+    if (input->numSchedSteps)
+      fprintf(stderr, "%s: SCHEDULE: %u steps\n", progname, input->numSchedSteps);
 
     /* Run the test case machinery in a subprocess, eventually this parent
        process should be a script or something which shells out to the actual
@@ -360,6 +378,7 @@ int main(int argc, char** argv) {
     } else if (pid == 0) {
       /* Create the input files, pipes, etc., and run the process. */
       replay_create_files(&__exe_fs);
+      setenv("KLEE_REPLAY_SCHEDULE", input_fname, 1);
       run_monitored(executable, prg_argc, prg_argv);
       _exit(0);
     } else {
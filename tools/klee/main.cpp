@@ -187,6 +187,15 @@ namespace {
 	       cl::desc("Specify a directory to replay .out files from"),
 	       cl::value_desc("output directory"));
 
+  cl::opt<std::string>
+  SchedPartitionDir("sched-partition-dir",
+                    cl::desc("Shared directory to queue the schedule prefixes exported with --sched-partition-states and to collect the races found"),
+                    cl::value_desc("directory"));
+
+  cl::opt<bool>
+  SchedPartitionWorker("sched-partition-worker",
+                       cl::desc("Explore the schedule prefixes queued in --sched-partition-dir until there are none left"));
+
   cl::opt<std::string>
   ReplayPathFile("replay-path",
                  cl::desc("Specify a path file to replay"),
@@ -231,10 +240,29 @@ private:
   unsigned m_testIndex;  // number of tests written so far
   unsigned m_pathsExplored; // number of paths explored so far
 
+  // parallel workers write test ids index+1, index+1+count, ...
+  unsigned m_workerIndex, m_workerCount;
+
+  // number of schedule prefixes exported so far
+  unsigned m_prefixIndex;
+
+  // schedule prefix being explored, its inputs are concrete in the states
+  const KTest *m_prefix;
+
   // used for writing .ktest files
   int m_argc;
   char **m_argv;
 
+  bool writeKTest(const ExecutionState &state,
+                  const std::vector< std::pair<std::string,
+                        std::vector<unsigned char> > > &out,
+                  const std::string &path);
+
+  void shareRace(const ExecutionState &state,
+                 const std::vector< std::pair<std::string,
+                       std::vector<unsigned char> > > &out,
+                 const char *race, unsigned id);
+
 public:
   KleeHandler(int argc, char **argv);
   ~KleeHandler();
@@ -244,8 +272,20 @@ public:
   unsigned getNumPathsExplored() { return m_pathsExplored; }
   void incPathsExplored() { m_pathsExplored++; }
 
+  unsigned getWorkerCount() { return m_workerCount; }
+  void setWorker(unsigned index, unsigned count);
+
+  // add or remove the marker of running/ keeping the workers waiting for the
+  // prefixes this process may export
+  void setExploring(bool exploring);
+  bool hasIdleWorkers();
+
   void setInterpreter(Interpreter *i);
 
+  bool exportSchedulePrefix(const ExecutionState &state);
+
+  void setSchedulePrefix(const KTest *prefix) { m_prefix = prefix; }
+
   void processTestCase(const ExecutionState  &state,
                        const char *errorMessage, 
                        const char *errorSuffix);
@@ -277,6 +317,10 @@ KleeHandler::KleeHandler(int argc, char **argv)
     m_outputDirectory(),
     m_testIndex(0),
     m_pathsExplored(0),
+    m_workerIndex(0),
+    m_workerCount(1),
+    m_prefixIndex(0),
+    m_prefix(0),
     m_argc(argc),
     m_argv(argv) {
 
@@ -413,6 +457,272 @@ llvm::raw_fd_ostream *KleeHandler::openTestFile(const std::string &suffix,
 }
 
 
+/***/
+
+// The shared partition directory holds the queues of schedule prefixes:
+// tmp/ while they are written, pending/ until a worker claims them, running/
+// while they are explored and done/ afterwards. The races found by every
+// process are collected in races/, and the processes waiting for prefixes
+// are listed in idle/.
+//
+// The entries of running/ are suffixed with "@<host>-<pid>" of the process
+// owning them: the prefixes it claimed, and a "main" marker while it runs an
+// exploration that may export prefixes. The entries of the dead processes of
+// the same host are recovered, so the other workers do not wait for them.
+
+static const char *partitionQueues[] = { "tmp", "pending", "running", "done", "races", "idle" };
+
+static std::string getPartitionPath(const char *queue, const std::string &name) {
+  return SchedPartitionDir + "/" + queue + "/" + name;
+}
+
+static std::string getHostName() {
+  char host[256];
+  if (gethostname(host, sizeof(host)) < 0)
+    strcpy(host, "localhost");
+  host[sizeof(host) - 1] = '\0';
+  return host;
+}
+
+// Process owning the entries it adds to running/
+static std::string getPartitionOwner() {
+  std::stringstream owner;
+  owner << getHostName() << '-' << getpid();
+  return owner.str();
+}
+
+// Name unique among the processes sharing the partition directory
+static std::string getPartitionUniqueName(unsigned index) {
+  std::stringstream name;
+  name << getPartitionOwner() << '-'
+       << std::setfill('0') << std::setw(6) << index;
+  return name.str();
+}
+
+static void initPartitionDir() {
+  if (mkdir(SchedPartitionDir.c_str(), 0775) < 0 && errno != EEXIST)
+    klee_error("cannot create \"%s\": %s", SchedPartitionDir.c_str(),
+               strerror(errno));
+
+  // The program may run in another directory (--run-in)
+  char *absolute = realpath(SchedPartitionDir.c_str(), NULL);
+  if (!absolute)
+    klee_error("cannot resolve \"%s\": %s", SchedPartitionDir.c_str(),
+               strerror(errno));
+  SchedPartitionDir = absolute;
+  free(absolute);
+
+  for (unsigned i = 0; i < sizeof(partitionQueues) / sizeof(partitionQueues[0]); ++i) {
+    std::string path = SchedPartitionDir + "/" + partitionQueues[i];
+    if (mkdir(path.c_str(), 0775) < 0 && errno != EEXIST)
+      klee_error("cannot create \"%s\": %s", path.c_str(), strerror(errno));
+  }
+}
+
+static void listPartitionQueue(const char *queue, std::vector<std::string> &names) {
+  std::string path = SchedPartitionDir + "/" + queue;
+  DIR *dir = opendir(path.c_str());
+  if (!dir)
+    klee_error("unable to read \"%s\": %s", path.c_str(), strerror(errno));
+  while (struct dirent *entry = readdir(dir)) {
+    if (entry->d_name[0] != '.')
+      names.push_back(entry->d_name);
+  }
+  closedir(dir);
+  std::sort(names.begin(), names.end());
+}
+
+// Claim a pending schedule prefix by moving it to running/. The rename is
+// atomic, so each prefix is claimed by a single worker. \a path is set to
+// the claimed entry of running/.
+static bool claimSchedulePrefix(std::string &name, std::string &path) {
+  std::vector<std::string> names;
+  listPartitionQueue("pending", names);
+  for (std::vector<std::string>::iterator it = names.begin(),
+         ie = names.end(); it != ie; ++it) {
+    std::string running =
+      getPartitionPath("running", *it + "@" + getPartitionOwner());
+    if (rename(getPartitionPath("pending", *it).c_str(), running.c_str()) == 0) {
+      name = *it;
+      path = running;
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool isPartitionOwnerAlive(const std::string &owner) {
+  // The processes of other hosts cannot be checked
+  size_t dash = owner.rfind('-');
+  if (dash == std::string::npos || owner.substr(0, dash) != getHostName())
+    return true;
+  pid_t pid = atoi(owner.c_str() + dash + 1);
+  return pid <= 0 || kill(pid, 0) == 0 || errno == EPERM;
+}
+
+// Requeue the prefixes claimed by dead processes and drop their markers
+static void recoverPartitionEntries() {
+  std::vector<std::string> idle;
+  listPartitionQueue("idle", idle);
+  for (std::vector<std::string>::iterator it = idle.begin(),
+         ie = idle.end(); it != ie; ++it) {
+    if (!isPartitionOwnerAlive(*it))
+      unlink(getPartitionPath("idle", *it).c_str());
+  }
+
+  std::vector<std::string> names;
+  listPartitionQueue("running", names);
+  for (std::vector<std::string>::iterator it = names.begin(),
+         ie = names.end(); it != ie; ++it) {
+    size_t at = it->rfind('@');
+    if (at == std::string::npos || isPartitionOwnerAlive(it->substr(at + 1)))
+      continue;
+
+    std::string path = getPartitionPath("running", *it);
+    std::string name = it->substr(0, at);
+    if (name == "main")
+      unlink(path.c_str());
+    else if (rename(path.c_str(), getPartitionPath("pending", name).c_str()) == 0)
+      klee_warning("requeued schedule prefix %s of dead process %s",
+                   name.c_str(), it->substr(at + 1).c_str());
+  }
+}
+
+// Move \a name, completely written in tmp/, to \a queue
+static bool publishPartitionFile(const char *queue, const std::string &name) {
+  std::string tmp = getPartitionPath("tmp", name);
+  if (rename(tmp.c_str(), getPartitionPath(queue, name).c_str()) < 0) {
+    unlink(tmp.c_str());
+    return false;
+  }
+  return true;
+}
+
+void KleeHandler::setWorker(unsigned index, unsigned count) {
+  m_workerIndex = index;
+  m_workerCount = count;
+
+  // The workers hand their states over to the idle ones through the
+  // partition directory, by default in the shared output directory
+  if (SchedPartitionDir == "") {
+    SchedPartitionDir = getOutputFilename("partition");
+    initPartitionDir();
+  }
+  setExploring(true);
+}
+
+void KleeHandler::setExploring(bool exploring) {
+  if (SchedPartitionDir == "")
+    return;
+
+  std::string marker = getPartitionPath("running", "main@" + getPartitionOwner());
+  if (exploring) {
+    std::ofstream f(marker.c_str());
+  } else {
+    unlink(marker.c_str());
+  }
+}
+
+bool KleeHandler::hasIdleWorkers() {
+  if (SchedPartitionDir == "")
+    return false;
+
+  // The idle workers claim the pending prefixes first
+  std::vector<std::string> pending, idle;
+  listPartitionQueue("pending", pending);
+  if (!pending.empty())
+    return false;
+  listPartitionQueue("idle", idle);
+  return !idle.empty();
+}
+
+bool KleeHandler::exportSchedulePrefix(const ExecutionState &state) {
+  if (SchedPartitionDir == "")
+    return false;
+
+  std::vector< std::pair<std::string, std::vector<unsigned char> > > out;
+  if (!m_interpreter->getSymbolicSolution(state, out))
+    return false;
+
+  std::string name = getPartitionUniqueName(m_prefixIndex++) + ".ktest";
+  if (!writeKTest(state, out, getPartitionPath("tmp", name))) {
+    unlink(getPartitionPath("tmp", name).c_str());
+    return false;
+  }
+  return publishPartitionFile("pending", name);
+}
+
+void KleeHandler::shareRace(const ExecutionState &state,
+                            const std::vector< std::pair<std::string,
+                                  std::vector<unsigned char> > > &out,
+                            const char *race, unsigned id) {
+  std::string name = getPartitionUniqueName(id);
+  std::string raceName = name + ".race";
+  {
+    std::ofstream f(getPartitionPath("tmp", raceName).c_str());
+    f << race;
+  }
+  if (!writeKTest(state, out, getPartitionPath("tmp", name + ".ktest")) ||
+      !publishPartitionFile("races", name + ".ktest") ||
+      !publishPartitionFile("races", raceName))
+    klee_warning("unable to share race test case %u", id);
+}
+
+bool KleeHandler::writeKTest(const ExecutionState &state,
+                             const std::vector< std::pair<std::string,
+                                   std::vector<unsigned char> > > &out,
+                             const std::string &path) {
+  KTest b;
+  b.numArgs = m_argc;
+  b.args = m_argv;
+  b.symArgvs = 0;
+  b.symArgvLen = 0;
+  if (m_prefix) {
+    // the replayed inputs were not made symbolic
+    assert(out.empty() && "symbolic inputs while replaying a prefix");
+    b.numObjects = m_prefix->numObjects;
+    b.objects = new KTestObject[b.numObjects];
+    assert(b.objects);
+    for (unsigned i=0; i<b.numObjects; i++) {
+      KTestObject *o = &b.objects[i];
+      o->name = m_prefix->objects[i].name;
+      o->numBytes = m_prefix->objects[i].numBytes;
+      o->bytes = new unsigned char[o->numBytes];
+      assert(o->bytes);
+      std::copy(m_prefix->objects[i].bytes,
+                m_prefix->objects[i].bytes + o->numBytes, o->bytes);
+    }
+  } else {
+    b.numObjects = out.size();
+    b.objects = new KTestObject[b.numObjects];
+    assert(b.objects);
+    for (unsigned i=0; i<b.numObjects; i++) {
+      KTestObject *o = &b.objects[i];
+      o->name = const_cast<char*>(out[i].first.c_str());
+      o->numBytes = out[i].second.size();
+      o->bytes = new unsigned char[o->numBytes];
+      assert(o->bytes);
+      std::copy(out[i].second.begin(), out[i].second.end(), o->bytes);
+    }
+  }
+
+  // The scheduling history is shared between states, only materialize it here
+  std::vector<Thread::thread_id_t> schedSteps;
+  state.schedulingHistory.getSteps(schedSteps);
+  b.numSchedSteps = schedSteps.size();
+  b.schedSteps = new long unsigned[b.numSchedSteps];
+  std::copy(schedSteps.begin(), schedSteps.end(), b.schedSteps);
+
+  bool success = kTest_toFile(&b, path.c_str());
+
+  for (unsigned i=0; i<b.numObjects; i++)
+    delete[] b.objects[i].bytes;
+  delete[] b.objects;
+  delete[] b.schedSteps;
+
+  return success;
+}
+
 /* Outputs all files (.ktest, .pc, .cov etc.) describing a test case */
 void KleeHandler::processTestCase(const ExecutionState &state,
                                   const char *errorMessage, 
@@ -435,44 +745,21 @@ void KleeHandler::processTestCase(const ExecutionState &state,
 
     double start_time = util::getWallTime();
 
-    unsigned id = ++m_testIndex;
-
-    if (success) {
-      KTest b;      
-      b.numArgs = m_argc;
-      b.args = m_argv;
-      b.symArgvs = 0;
-      b.symArgvLen = 0;
-      b.numObjects = out.size();
-      b.objects = new KTestObject[b.numObjects];
-      assert(b.objects);
-      for (unsigned i=0; i<b.numObjects; i++) {
-        KTestObject *o = &b.objects[i];
-        o->name = const_cast<char*>(out[i].first.c_str());
-        o->numBytes = out[i].second.size();
-        o->bytes = new unsigned char[o->numBytes];
-        assert(o->bytes);
-        std::copy(out[i].second.begin(), out[i].second.end(), o->bytes);
-      }
-
-      b.numSchedSteps = state.schedulingHistory.size();
-      b.schedSteps = new long unsigned[b.numSchedSteps];
-      std::copy(state.schedulingHistory.begin(),state.schedulingHistory.end(),b.schedSteps);
+    unsigned id = m_testIndex++ * m_workerCount + m_workerIndex + 1;
 
-      if (!kTest_toFile(&b, getOutputFilename(getTestFilename("ktest", id)).c_str())) {
-        klee_warning("unable to write output test case, losing it");
-      }
-
-      for (unsigned i=0; i<b.numObjects; i++)
-        delete[] b.objects[i].bytes;
-      delete[] b.objects;
-    }
+    if (success &&
+        !writeKTest(state, out, getOutputFilename(getTestFilename("ktest", id))))
+      klee_warning("unable to write output test case, losing it");
 
     if (errorMessage) {
       llvm::raw_ostream *f = openTestFile(errorSuffix, id);
       *f << errorMessage;
       delete f;
     }
+
+    if (success && errorMessage && SchedPartitionDir != "" &&
+        !strcmp(errorSuffix, "race"))
+      shareRace(state, out, errorMessage, id);
     
     if (m_pathWriter) {
       std::vector<unsigned char> concreteBranches;
@@ -769,7 +1056,12 @@ static const char *modelledExternals[] = {
   "klee_thread_sleep",
   "klee_thread_terminate",
   "klee_vclock_send",
+  "klee_vclock_acquire",
+  "klee_vclock_release",
+  "klee_vclock_fork",
+  "klee_vclock_clear",
   "klee_mem_access",
+  "klee_mem_access_range",
   "klee_lockset_update",
   "klee_get_time",
   "klee_set_time",
@@ -986,6 +1278,57 @@ static void interrupt_handle_watchdog() {
   // just wait for the child to finish
 }
 
+// Explore the schedule prefixes queued in the partition directory. Prefixes
+// are only added by the processes exploring the running ones, so stop once
+// both queues are empty.
+static void exploreSchedulePrefixes(Interpreter *interpreter,
+                                    KleeHandler *handler,
+                                    Function *mainFn, char **envp) {
+  llvm::raw_ostream &infoFile = handler->getInfoStream();
+  std::string idle = getPartitionPath("idle", getPartitionOwner());
+
+  while (!interrupted) {
+    std::string name, path;
+    if (!claimSchedulePrefix(name, path)) {
+      recoverPartitionEntries();
+      std::vector<std::string> pending, running;
+      listPartitionQueue("pending", pending);
+      listPartitionQueue("running", running);
+      if (pending.empty() && running.empty())
+        break;
+      if (pending.empty()) {
+        // Ask the running processes to hand states over
+        { std::ofstream f(idle.c_str()); }
+        sleep(1);
+      }
+      continue;
+    }
+    unlink(idle.c_str());
+
+    KTest *out = kTest_fromFile(path.c_str());
+    if (out) {
+      unsigned numTests = handler->getNumTestCases();
+      interpreter->setReplayOut(out);
+      handler->setSchedulePrefix(out);
+      llvm::errs() << "KLEE: exploring schedule prefix: " << name
+                   << " (" << out->numSchedSteps << " steps)\n";
+      interpreter->runFunctionAsMain(mainFn, out->numArgs, out->args, envp);
+      interpreter->setReplayOut(0);
+      handler->setSchedulePrefix(0);
+      kTest_free(out);
+      infoFile << "Schedule prefix " << name << ": "
+               << handler->getNumTestCases() - numTests << " tests\n";
+    } else {
+      llvm::errs() << "KLEE: unable to open: " << path << "\n";
+    }
+
+    if (rename(path.c_str(), getPartitionPath("done", name).c_str()) < 0)
+      klee_warning("unable to move %s to done: %s", name.c_str(),
+                   strerror(errno));
+  }
+  unlink(idle.c_str());
+}
+
 // This is a temporary hack. If the running process has access to
 // externals then it can disable interrupts, which screws up the
 // normal "nice" watchdog termination process. We try to request the
@@ -1290,7 +1633,18 @@ int main(int argc, char **argv, char **envp) {
   {
     PassManager pm;
     const llvm::DataLayout &DL = DataLayout(mainModule);
-    pm.add(new InstrumentAccesses(DL));
+    // Scalar evolution needs the layout to compute the stride of accesses
+#if LLVM_VERSION_CODE < LLVM_VERSION(3, 5)
+    pm.add(new DataLayout(mainModule));
+#else
+    pm.add(new DataLayoutPass(mainModule));
+#endif
+    // A coalesced range access is logged after its loop, so it would get no
+    // preemption point between the accesses it stands for
+    bool coalesceLoops = !ThreadPreemptionPass::preemptsBeforeAccesses();
+    if (!coalesceLoops)
+      klee_message("NOTE: not coalescing loop accesses, to preempt before each of them");
+    pm.add(new InstrumentAccesses(DL, coalesceLoops));
     pm.run(*mainModule);
   }
 
@@ -1397,8 +1751,14 @@ int main(int argc, char **argv, char **envp) {
     KleeHandler::loadPathFile(ReplayPathFile, replayPath);
   }
 
+  if (SchedPartitionWorker && SchedPartitionDir == "")
+    klee_error("--sched-partition-worker used without --sched-partition-dir");
+  if (SchedPartitionDir != "")
+    initPartitionDir();
+
   Interpreter::InterpreterOptions IOpts;
   IOpts.MakeConcreteSymbolic = MakeConcreteSymbolic;
+  IOpts.AllowPartialScheduling = SchedPartitionWorker;
   KleeHandler *handler = new KleeHandler(pArgc, pArgv);
   Interpreter *interpreter = 
     theInterpreter = Interpreter::create(IOpts, handler);
@@ -1425,7 +1785,20 @@ int main(int argc, char **argv, char **envp) {
   infoFile << buf;
   infoFile.flush();
 
-  if (!ReplayOutDir.empty() || !ReplayOutFile.empty()) {
+  if (SchedPartitionWorker) {
+    assert(ReplayOutFile.empty() && ReplayOutDir.empty());
+    assert(SeedOutFile.empty());
+    assert(SeedOutDir.empty());
+
+    if (RunInDir != "") {
+      int res = chdir(RunInDir.c_str());
+      if (res < 0) {
+        klee_error("Unable to change directory to: %s", RunInDir.c_str());
+      }
+    }
+
+    exploreSchedulePrefixes(interpreter, handler, mainFn, pEnvp);
+  } else if (!ReplayOutDir.empty() || !ReplayOutFile.empty()) {
     assert(SeedOutFile.empty());
     assert(SeedOutDir.empty());
 
@@ -1514,13 +1887,23 @@ int main(int argc, char **argv, char **envp) {
         klee_error("Unable to change directory to: %s", RunInDir.c_str());
       }
     }
+    // Keep the workers waiting for the prefixes this run may still export
+    handler->setExploring(true);
     interpreter->runFunctionAsMain(mainFn, pArgc, pArgv, pEnvp);
+    handler->setExploring(false);
+
+    // The parallel workers that run out of states explore the ones handed
+    // over by the others
+    if (handler->getWorkerCount() > 1)
+      exploreSchedulePrefixes(interpreter, handler, mainFn, pEnvp);
 
     while (!seeds.empty()) {
       kTest_free(seeds.back());
       seeds.pop_back();
     }
   }
+
+  interpreter->waitWorkers();
       
   t[1] = time(NULL);
   strftime(buf, sizeof(buf), "Finished: %Y-%m-%d %H:%M:%S\n", localtime(&t[1]));